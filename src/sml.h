@@ -1,8 +1,23 @@
-#ifndef SML_SML_H
-#define SML_SML_H
-
-#include "smldef.h"
-#include "smlobj.h"
-#include "smlparse.h"
-
+#ifndef SML_SML_H
+#define SML_SML_H
+
+#include "smldef.h"
+#include "smlhash.h"
+#include "smlkey.h"
+#include "smlobj.h"
+#include "smldedup.h"
+#include "smldiff.h"
+#include "smloverlay.h"
+#include "smlparse.h"
+#include "smlreclaim.h"
+#include "smlincremental.h"
+#include "smlreload.h"
+#include "smltransaction.h"
+#include "smlvisit.h"
+#include "smlfrozen.h"
+#include "smlliteral.h"
+#include "smlbinary.h"
+#include "smlgen.h"
+#include "smlbind.h"
+
 #endif
\ No newline at end of file
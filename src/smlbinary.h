@@ -0,0 +1,154 @@
+#ifndef SML_SMLBINARY_H
+#define SML_SMLBINARY_H
+
+#include "smldef.h"
+#include "smlfrozen.h"
+#include "smlhash.h"
+#include "smlparse.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+
+namespace sml
+{
+    /// Write the block of the frozen document as a .smlb file.
+    /// The block is written to a temporary file renamed to the path, so readers never see a partial file.
+    /// The file is read back only by builds of the same byte order, integer_t and real_t.
+    inline void saveFrozen(const FrozenDocument& doc, const std::string& path)
+    {
+        const auto salt = hashCombine(std::hash<std::thread::id>()(std::this_thread::get_id()),
+                                      static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+        std::ostringstream tmp;
+        tmp << path << '.' << std::hex << salt << ".tmp";
+
+        const auto size = frozen::at<frozen::Header>(doc.data(), 0)->size;
+        {
+            std::ofstream out(tmp.str(), std::ios::binary | std::ios::trunc);
+            if (!out.write(reinterpret_cast<const char*>(doc.data()), static_cast<std::streamsize>(size)) || !out.flush())
+            {
+                out.close();
+                std::remove(tmp.str().c_str());
+                throw std::runtime_error("Failed to write file (" + path + ")");
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmp.str(), path, ec);
+        if (ec)
+        {
+            std::remove(tmp.str().c_str());
+            throw std::runtime_error("Failed to write file (" + path + ")");
+        }
+    }
+
+    namespace detail
+    {
+        /// Read the whole file into a new block aligned to frozen::Align.
+        inline std::shared_ptr<const unsigned char> readFile(const std::string& path, size_t& size)
+        {
+            std::ifstream in(path, std::ios::binary | std::ios::ate);
+            if (!in.is_open())
+            {
+                throw ParseException("Failed to open file (" + path + ")");
+            }
+            size = static_cast<size_t>(in.tellg());
+            if (size < sizeof(frozen::Header))
+            {
+                throw ParseException("Not a frozen document (" + path + ")");
+            }
+
+            const auto p = static_cast<unsigned char*>(::operator new(size, std::align_val_t(frozen::Align)));
+            std::shared_ptr<const unsigned char> data(p, [](const unsigned char* q) {
+                ::operator delete(const_cast<unsigned char*>(q), std::align_val_t(frozen::Align));
+            });
+            in.seekg(0);
+            if (!in.read(reinterpret_cast<char*>(p), static_cast<std::streamsize>(size)))
+            {
+                throw ParseException("Failed to read file (" + path + ")");
+            }
+            return data;
+        }
+    }
+
+    /// Load a .smlb file written by saveFrozen() without parsing, reading it whole.
+    /// mapFrozen() of smlmmap.h maps the file instead.
+    /// If 'verify' is true, the checksum is checked first.
+    /// Throw ParseException if the file is not a frozen document of this version.
+    inline FrozenDocument loadFrozen(const std::string& path, bool verify = true)
+    {
+        size_t size = 0;
+        auto data = detail::readFile(path, size);
+
+        FrozenDocument doc(std::move(data), size);
+        if (verify && !doc.verify())
+        {
+            throw ParseException("Checksum mismatch (" + path + ")");
+        }
+        return doc;
+    }
+
+    /// Function loading a .smlb file, loadFrozen or mapFrozen of smlmmap.h.
+    using FrozenLoader = FrozenDocument (*)(const std::string& path, bool verify);
+
+    /// Return the frozen document of a .sml file, through a cache of .smlb files in the directory.
+    /// Cached images are named by the hash of the source text and the layout, so a changed file
+    /// or an incompatible build misses the cache. On a miss the text is parsed, frozen and cached.
+    /// Cached images are loaded by 'load'. Failing to write the cache is ignored.
+    inline FrozenDocument parseCached(const std::string& path, const std::string& cacheDir,
+                                      const FreezeOptions& options = FreezeOptions(), FrozenLoader load = loadFrozen)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open())
+        {
+            throw ParseException("Failed to open file (" + path + ")");
+        }
+        std::ostringstream buf;
+        buf << in.rdbuf();
+        const auto text = buf.str();
+
+        auto h = hashBytes(text.data(), text.size());
+        h = hashCombine(h, frozen::Version);
+        h = hashCombine(h, sizeof(integer_t));
+        h = hashCombine(h, sizeof(real_t));
+        h = hashCombine(h, options.perfectHash ? options.perfectHashMinKeys : 0);
+        std::ostringstream name;
+        name << std::hex << h << ".smlb";
+        const auto cached = (std::filesystem::path(cacheDir) / name.str()).string();
+
+        std::error_code ec;
+        if (std::filesystem::exists(cached, ec))
+        {
+            try
+            {
+                return load(cached, true);
+            }
+            catch (const ParseException&)
+            {
+                // Broken image, made again below
+            }
+        }
+
+        const auto doc = freeze(Parser().parseText(text), options);
+        try
+        {
+            std::filesystem::create_directories(cacheDir, ec);
+            saveFrozen(doc, cached);
+        }
+        catch (const std::runtime_error&)
+        {
+        }
+        return doc;
+    }
+}
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef SML_SMLBIND_H
+#define SML_SMLBIND_H
+
+#include "smldef.h"
+#include "smlobj.h"
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// Bind the members of a struct to the keys of their names, up to 32 members.
+/// Put it in the namespace of the struct, such as
+///   struct Child { std::string color; int size; std::optional<std::string> food; };
+///   SML_BIND(Child, color, size, food)
+/// Members are integral or floating point types, std::string, structs bound by SML_BIND,
+/// std::vector of them, or std::optional of them for keys which may be missing.
+#define SML_BIND(Type, ...)                                                                             \
+    inline auto smlFields(const Type*)                                                                  \
+    {                                                                                                   \
+        using SmlBound = Type;                                                                          \
+        return std::make_tuple(SML_DETAIL_EXPAND(SML_DETAIL_FOR_EACH(SML_DETAIL_FIELD, __VA_ARGS__)));  \
+    }
+
+#define SML_DETAIL_FIELD(m) ::sml::boundField(#m, &SmlBound::m)
+
+// Expanding once more lets MSVC split __VA_ARGS__
+#define SML_DETAIL_EXPAND(x) x
+#define SML_DETAIL_SELECT(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, NAME, ...) NAME
+#define SML_DETAIL_FOR_EACH(f, ...) \
+    SML_DETAIL_EXPAND(SML_DETAIL_SELECT(__VA_ARGS__, SML_DETAIL_FE_32, SML_DETAIL_FE_31, SML_DETAIL_FE_30, SML_DETAIL_FE_29, SML_DETAIL_FE_28, SML_DETAIL_FE_27, SML_DETAIL_FE_26, SML_DETAIL_FE_25, SML_DETAIL_FE_24, SML_DETAIL_FE_23, SML_DETAIL_FE_22, SML_DETAIL_FE_21, SML_DETAIL_FE_20, SML_DETAIL_FE_19, SML_DETAIL_FE_18, SML_DETAIL_FE_17, SML_DETAIL_FE_16, SML_DETAIL_FE_15, SML_DETAIL_FE_14, SML_DETAIL_FE_13, SML_DETAIL_FE_12, SML_DETAIL_FE_11, SML_DETAIL_FE_10, SML_DETAIL_FE_9, SML_DETAIL_FE_8, SML_DETAIL_FE_7, SML_DETAIL_FE_6, SML_DETAIL_FE_5, SML_DETAIL_FE_4, SML_DETAIL_FE_3, SML_DETAIL_FE_2, SML_DETAIL_FE_1)(f, __VA_ARGS__))
+#define SML_DETAIL_FE_1(f, x) f(x)
+#define SML_DETAIL_FE_2(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_1(f, __VA_ARGS__))
+#define SML_DETAIL_FE_3(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_2(f, __VA_ARGS__))
+#define SML_DETAIL_FE_4(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_3(f, __VA_ARGS__))
+#define SML_DETAIL_FE_5(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_4(f, __VA_ARGS__))
+#define SML_DETAIL_FE_6(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_5(f, __VA_ARGS__))
+#define SML_DETAIL_FE_7(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_6(f, __VA_ARGS__))
+#define SML_DETAIL_FE_8(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_7(f, __VA_ARGS__))
+#define SML_DETAIL_FE_9(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_8(f, __VA_ARGS__))
+#define SML_DETAIL_FE_10(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_9(f, __VA_ARGS__))
+#define SML_DETAIL_FE_11(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_10(f, __VA_ARGS__))
+#define SML_DETAIL_FE_12(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_11(f, __VA_ARGS__))
+#define SML_DETAIL_FE_13(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_12(f, __VA_ARGS__))
+#define SML_DETAIL_FE_14(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_13(f, __VA_ARGS__))
+#define SML_DETAIL_FE_15(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_14(f, __VA_ARGS__))
+#define SML_DETAIL_FE_16(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_15(f, __VA_ARGS__))
+#define SML_DETAIL_FE_17(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_16(f, __VA_ARGS__))
+#define SML_DETAIL_FE_18(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_17(f, __VA_ARGS__))
+#define SML_DETAIL_FE_19(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_18(f, __VA_ARGS__))
+#define SML_DETAIL_FE_20(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_19(f, __VA_ARGS__))
+#define SML_DETAIL_FE_21(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_20(f, __VA_ARGS__))
+#define SML_DETAIL_FE_22(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_21(f, __VA_ARGS__))
+#define SML_DETAIL_FE_23(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_22(f, __VA_ARGS__))
+#define SML_DETAIL_FE_24(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_23(f, __VA_ARGS__))
+#define SML_DETAIL_FE_25(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_24(f, __VA_ARGS__))
+#define SML_DETAIL_FE_26(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_25(f, __VA_ARGS__))
+#define SML_DETAIL_FE_27(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_26(f, __VA_ARGS__))
+#define SML_DETAIL_FE_28(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_27(f, __VA_ARGS__))
+#define SML_DETAIL_FE_29(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_28(f, __VA_ARGS__))
+#define SML_DETAIL_FE_30(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_29(f, __VA_ARGS__))
+#define SML_DETAIL_FE_31(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_30(f, __VA_ARGS__))
+#define SML_DETAIL_FE_32(f, x, ...) f(x), SML_DETAIL_EXPAND(SML_DETAIL_FE_31(f, __VA_ARGS__))
+
+namespace sml
+{
+    /// Member of a struct bound to a key.
+    template <class S, class M>
+    struct BoundField
+    {
+        std::string_view key;
+        M S::*member;
+    };
+
+    template <class S, class M>
+    constexpr BoundField<S, M> boundField(std::string_view key, M S::*member)
+    {
+        return BoundField<S, M>{ key, member };
+    }
+
+    namespace detail
+    {
+        template <class T, class = void>
+        struct IsBound : std::false_type {};
+
+        template <class T>
+        struct IsBound<T, std::void_t<decltype(smlFields(static_cast<const T*>(nullptr)))>> : std::true_type {};
+
+        template <class T>
+        struct IsOptional : std::false_type {};
+
+        template <class T>
+        struct IsOptional<std::optional<T>> : std::true_type {};
+
+        template <class T>
+        void bindTable(const table_t& t, T& out);
+
+        template <class T>
+        void bindNode(const Value& val, T& out);
+
+        template <class T>
+        void bindElement(const array_t& arr, size_t i, T& out)
+        {
+            if constexpr (IsBound<T>::value)
+            {
+                bindTable(arr.valueAs<table_t>(i), out);
+            }
+            else if constexpr (IsVector<T>::value)
+            {
+                bindNode(arr.valueAs<array_t>(i), out);
+            }
+            else
+            {
+                out = static_cast<T>(arr.valueAs<SourceType_t<T>>(i));
+            }
+        }
+
+        template <class T>
+        void bindNode(const Value& val, T& out)
+        {
+            if constexpr (IsBound<T>::value)
+            {
+                bindTable(sml::valueAs<table_t>(val), out);
+            }
+            else if constexpr (IsOptional<T>::value)
+            {
+                bindNode(val, out.emplace());
+            }
+            else if constexpr (IsVector<T>::value)
+            {
+                using E = typename T::value_type;
+                const auto& arr = sml::valueAs<array_t>(val);
+                if constexpr (std::is_arithmetic<E>::value)
+                {
+                    if (!arr.arrayIs<SourceType_t<E>>())
+                    {
+                        throw MismatchType();
+                    }
+                    out = arr.toVector<E>();
+                }
+                else
+                {
+                    out.clear();
+                    out.resize(arr.length());
+                    for (size_t i = 0; i < arr.length(); ++i)
+                    {
+                        bindElement(arr, i, out[i]);
+                    }
+                }
+            }
+            else
+            {
+                out = static_cast<T>(sml::valueAs<SourceType_t<T>>(val));
+            }
+        }
+
+        template <class T, class Fields, size_t... I>
+        void bindTable(const table_t& t, T& out, const Fields& fields, std::index_sequence<I...>)
+        {
+            constexpr auto N = sizeof...(I);
+            const std::string_view keys[N] = { std::get<I>(fields).key... };
+            constexpr bool optional[N] = { IsOptional<std::decay_t<decltype(out.*(std::get<I>(fields).member))>>::value... };
+            bool found[N] = {};
+
+            // Keys are usually in the order of the members, try the next one first
+            size_t hint = 0;
+            for (const auto e : t)
+            {
+                auto i = hint < N && keys[hint] == e.first ? hint : 0;
+                while (i < N && keys[i] != e.first)
+                {
+                    ++i;
+                }
+                if (i == N)
+                {
+                    continue; // Not bound
+                }
+
+                ((i == I ? bindNode(e.second, out.*(std::get<I>(fields).member)) : void()), ...);
+                found[i] = true;
+                hint = i + 1;
+            }
+
+            for (size_t i = 0; i < N; ++i)
+            {
+                if (!found[i] && !optional[i])
+                {
+                    throw KeyNotFound("key not found (" + std::string(keys[i]) + ")");
+                }
+            }
+        }
+
+        template <class T>
+        void bindTable(const table_t& t, T& out)
+        {
+            const auto fields = smlFields(static_cast<const T*>(nullptr));
+            bindTable(t, out, fields, std::make_index_sequence<std::tuple_size<decltype(fields)>::value>());
+        }
+    }
+
+    /// Fill the struct bound by SML_BIND from the table, visiting each entry once.
+    /// Keys not bound are ignored.
+    /// Throw KeyNotFound if a key of a member not optional is missing,
+    /// MismatchType if a value is not of the type of the member.
+    template <class T>
+    void bind(const table_t& t, T& out)
+    {
+        static_assert(detail::IsBound<T>::value, "T is not bound by SML_BIND");
+        detail::bindTable(t, out);
+    }
+
+    /// Return a struct bound by SML_BIND filled from the table.
+    template <class T>
+    T bindAs(const table_t& t)
+    {
+        T out{};
+        bind(t, out);
+        return out;
+    }
+
+    /// ditto
+    template <class T>
+    T bindAs(const std::shared_ptr<const table_t>& t)
+    {
+        return bindAs<T>(*t);
+    }
+}
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef SML_SMLDEDUP_H
+#define SML_SMLDEDUP_H
+
+#include "smldef.h"
+#include "smlobj.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sml
+{
+    /// Result of dedup().
+    struct DedupStats
+    {
+        size_t values = 0; // Integers, reals and strings
+        size_t arrays = 0;
+        size_t tables = 0;
+        size_t bytes = 0; // Approximate bytes of the released nodes
+    };
+
+    namespace detail
+    {
+        /// Bytes held outside of the string object.
+        inline size_t heapBytes(const std::string& s)
+        {
+            const auto p = reinterpret_cast<const char*>(&s);
+            const auto inside = p <= s.data() && s.data() < p + sizeof(s);
+            return inside ? 0 : s.capacity() + 1;
+        }
+
+        /// Bitwise equality, so that reals equal only to the same representation.
+        /// Unlike equal(), 0.0 and -0.0 are kept apart, as sharing one would change the other.
+        inline bool sameBytes(const void* a, const void* b, size_t n)
+        {
+            return n == 0 || std::memcmp(a, b, n) == 0;
+        }
+
+        template <class T>
+        size_t heapBytes(const std::vector<T>& v)
+        {
+            return v.capacity() * sizeof(T);
+        }
+
+        inline size_t heapBytes(const std::vector<string_t>& v)
+        {
+            size_t n = v.capacity() * sizeof(string_t);
+            for (const auto& s : v)
+            {
+                n += heapBytes(s);
+            }
+            return n;
+        }
+
+        /// Hash-conses nodes bottom up.
+        /// Once the children are shared, two nodes are equal if their own contents
+        /// and the pointers of their children are equal, so no subtree is compared twice.
+        class Deduplicator
+        {
+        private:
+            std::unordered_map<uint64_t, std::vector<std::shared_ptr<Value>>> nodes_;
+            DedupStats stats_;
+
+        public:
+            DedupStats run(table_t& root)
+            {
+                visitChildren(root);
+                return stats_;
+            }
+
+        private:
+            /// Replace the node by an equal node seen before.
+            void visit(std::shared_ptr<Value>& node)
+            {
+                if (node->type() == ValueType::Array)
+                {
+                    visitChildren(static_cast<array_t&>(*node));
+                }
+                else if (node->type() == ValueType::Table)
+                {
+                    visitChildren(static_cast<table_t&>(*node));
+                }
+
+                // Children are replaced by equal ones, so their cached hashes stay valid.
+                auto& bucket = nodes_[structuralHash(*node)];
+                for (const auto& other : bucket)
+                {
+                    if (equals(*other, *node))
+                    {
+                        if (node.use_count() == 1)
+                        {
+                            count(*node);
+                        }
+                        node = other;
+                        return;
+                    }
+                }
+                bucket.emplace_back(node);
+            }
+
+            void visitChildren(table_t& table)
+            {
+                for (auto& v : table.values_)
+                {
+                    visit(v);
+                }
+            }
+
+            void visitChildren(array_t& arr)
+            {
+                // Rows of a packed array are views of one buffer, keep them as they are.
+                if (arr.packed())
+                {
+                    return;
+                }
+                for (auto& e : arr.nodes_)
+                {
+                    visit(e);
+                }
+            }
+
+            static bool equals(const Value& a, const Value& b)
+            {
+                if (a.type() != b.type())
+                {
+                    return false;
+                }
+                switch (a.type())
+                {
+                case ValueType::Integer:
+                    return static_cast<const Integer&>(a).ref() == static_cast<const Integer&>(b).ref();
+                case ValueType::Real:
+                {
+                    const auto x = static_cast<const Real&>(a).ref();
+                    const auto y = static_cast<const Real&>(b).ref();
+                    return sameBytes(&x, &y, sizeof(x));
+                }
+                case ValueType::String:
+                    return static_cast<const String&>(a).ref() == static_cast<const String&>(b).ref();
+                case ValueType::Array:
+                    return equals(static_cast<const array_t&>(a), static_cast<const array_t&>(b));
+                case ValueType::Table:
+                    return equals(static_cast<const table_t&>(a), static_cast<const table_t&>(b));
+                default:
+                    return false;
+                }
+            }
+
+            static bool equals(const table_t& a, const table_t& b)
+            {
+                if (a.values_.size() != b.values_.size())
+                {
+                    return false;
+                }
+                for (size_t i = 0; i < a.values_.size(); ++i)
+                {
+                    if (a.values_[i] != b.values_[i] || a.shape_->key(i) != b.shape_->key(i))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            static bool equals(const array_t& a, const array_t& b)
+            {
+                if (a.elementType_ != b.elementType_ || a.length() != b.length() || a.packed() != b.packed())
+                {
+                    return false;
+                }
+                if (a.packed())
+                {
+                    if (a.scalarType() != b.scalarType() || a.shape() != b.shape())
+                    {
+                        return false;
+                    }
+                    return a.scalarType() == ValueType::Integer
+                               ? equalRange(a.template ndview<integer_t>(), b.template ndview<integer_t>())
+                               : equalRange(a.template ndview<real_t>(), b.template ndview<real_t>());
+                }
+                switch (a.elementType_)
+                {
+                case ValueType::Integer:
+                    return a.integers_ == b.integers_;
+                case ValueType::Real:
+                    return sameBytes(a.reals_.data(), b.reals_.data(), a.reals_.size() * sizeof(real_t));
+                case ValueType::String:
+                    return a.strings_ == b.strings_;
+                default:
+                    return a.nodes_ == b.nodes_;
+                }
+            }
+
+            template <class T>
+            static bool equalRange(const NDView<T>& a, const NDView<T>& b)
+            {
+                return sameBytes(a.data(), b.data(), a.size() * sizeof(T));
+            }
+
+            /// Count the node about to be released. Its children are counted when they were shared.
+            void count(const Value& node)
+            {
+                switch (node.type())
+                {
+                case ValueType::Integer:
+                    ++stats_.values;
+                    stats_.bytes += sizeof(Integer);
+                    break;
+                case ValueType::Real:
+                    ++stats_.values;
+                    stats_.bytes += sizeof(Real);
+                    break;
+                case ValueType::String:
+                    ++stats_.values;
+                    stats_.bytes += sizeof(String) + heapBytes(static_cast<const String&>(node).ref());
+                    break;
+                case ValueType::Array:
+                {
+                    const auto& arr = static_cast<const array_t&>(node);
+                    ++stats_.arrays;
+                    stats_.bytes += sizeof(array_t) + heapBytes(arr.integers_) + heapBytes(arr.reals_) +
+                                    heapBytes(arr.strings_) + heapBytes(arr.nodes_);
+                    if (arr.dense_ && arr.dim_ == 0)
+                    {
+                        stats_.bytes += heapBytes(arr.dense_->integers) + heapBytes(arr.dense_->reals);
+                    }
+                    break;
+                }
+                case ValueType::Table:
+                    ++stats_.tables;
+                    stats_.bytes += sizeof(table_t) + heapBytes(static_cast<const table_t&>(node).values_);
+                    break;
+                default:
+                    break;
+                }
+            }
+        };
+    }
+
+    /// Make identical values and subtrees under the table share one node.
+    /// Strings inside string arrays are stored by value and not shared.
+    /// Shared nodes are seen from every place, so the table should not be modified after this.
+    inline DedupStats dedup(table_t& root)
+    {
+        return detail::Deduplicator().run(root);
+    }
+}
+
+#endif
@@ -1,102 +1,236 @@
-#ifndef SML_SMLDEF_H
-#define SML_SMLDEF_H
-
-#include <exception>
-#include <string>
-
-namespace sml
-{
-    /// Will be throwed on a .sml file is not support to the format.
-    class ParseException : public std::runtime_error
-    {
-    public:
-        explicit ParseException(const std::string& msg = "parse exception")
-            : std::runtime_error(msg) {}
-    };
-
-    /// Will be throwed on a key not found.
-    class KeyNotFound : public std::runtime_error
-    {
-    public:
-        explicit KeyNotFound(const std::string& msg = "key not found")
-            : std::runtime_error(msg) {}
-    };
-
-    /// Will be throwed on type mismatched.
-    class MismatchType : public std::runtime_error
-    {
-    public:
-        explicit MismatchType(const std::string& msg = "mismatch type")
-            : std::runtime_error(msg) {}
-    };
-
-    /// Integer type
-    using integer_t = int;
-
-    /// Real type
-#ifdef SML_DOUBLE
-    using real_t = double;
-#else
-    using real_t = float;
-#endif
-
-    /// String type
-    using string_t = std::string;
-
-    /// Array type
-    class array_t;
-
-    /// table type
-    class table_t;
-
-    /// Null type
-    struct Null {};
-
-    class Integer;
-    class Real;
-    class String;
-
-    template <class T>
-    struct ObjectType
-    {
-        using type = T;
-    };
-
-    template <>
-    struct ObjectType<integer_t>
-    {
-        using type = Integer;
-    };
-
-    template <>
-    struct ObjectType<real_t>
-    {
-        using type = Real;
-    };
-
-    template <>
-    struct ObjectType<string_t>
-    {
-        using type = String;
-    };
-
-    template <class T>
-    using ObjectType_t = typename ObjectType<T>::type;
-
-    template <class T>
-    struct TypeTag {};
-
-    /// Type visitor
-    struct Visitor
-    {
-        ~Visitor() = default;
-        virtual void visit(const integer_t&) {}
-        virtual void visit(const real_t&) {}
-        virtual void visit(const string_t&) {}
-        virtual void visit(const array_t&) {}
-        virtual void visit(const table_t&) {}
-        virtual void visit(Null) {}
-    };
-}
-
-#endif
+#ifndef SML_SMLDEF_H
+#define SML_SMLDEF_H
+
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+#if __cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)
+#include <span>
+#define SML_HAS_STD_SPAN
+#endif
+
+namespace sml
+{
+    /// Will be throwed on a .sml file is not support to the format.
+    class ParseException : public std::runtime_error
+    {
+    public:
+        explicit ParseException(const std::string& msg = "parse exception")
+            : std::runtime_error(msg) {}
+    };
+
+    /// Will be throwed on a key not found.
+    class KeyNotFound : public std::runtime_error
+    {
+    public:
+        explicit KeyNotFound(const std::string& msg = "key not found")
+            : std::runtime_error(msg) {}
+    };
+
+    /// Will be throwed on type mismatched.
+    class MismatchType : public std::runtime_error
+    {
+    public:
+        explicit MismatchType(const std::string& msg = "mismatch type")
+            : std::runtime_error(msg) {}
+    };
+
+    /// Integer type
+    using integer_t = int;
+
+    /// Real type
+#ifdef SML_DOUBLE
+    using real_t = double;
+#else
+    using real_t = float;
+#endif
+
+    /// String type
+    using string_t = std::string;
+
+    /// Array type
+    class array_t;
+
+    /// table type
+    class table_t;
+
+    /// Null type
+    struct Null {};
+
+#ifdef SML_HAS_STD_SPAN
+    /// Contiguous sequence of elements
+    template <class T>
+    using span = std::span<T>;
+#else
+    /// Contiguous sequence of elements, a subset of std::span
+    template <class T>
+    class span
+    {
+    private:
+        T* data_ = nullptr;
+        std::size_t size_ = 0;
+
+    public:
+        using element_type = T;
+        using iterator = T*;
+
+        constexpr span() = default;
+
+        constexpr span(T* data, std::size_t size)
+            : data_(data)
+            , size_(size)
+        {
+        }
+
+        constexpr T* data() const
+        {
+            return data_;
+        }
+
+        constexpr std::size_t size() const
+        {
+            return size_;
+        }
+
+        constexpr bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        constexpr T& operator[](std::size_t i) const
+        {
+            return data_[i];
+        }
+
+        constexpr T* begin() const
+        {
+            return data_;
+        }
+
+        constexpr T* end() const
+        {
+            return data_ + size_;
+        }
+    };
+#endif
+
+    class Integer;
+    class Real;
+    class String;
+
+    template <class T>
+    struct ObjectType
+    {
+        using type = T;
+    };
+
+    template <>
+    struct ObjectType<integer_t>
+    {
+        using type = Integer;
+    };
+
+    template <>
+    struct ObjectType<real_t>
+    {
+        using type = Real;
+    };
+
+    template <>
+    struct ObjectType<string_t>
+    {
+        using type = String;
+    };
+
+    template <class T>
+    using ObjectType_t = typename ObjectType<T>::type;
+
+    template <class T>
+    struct TypeTag {};
+
+    /// Type tag of values, usable for static dispatch
+    enum class ValueType
+    {
+        Null,
+        Integer,
+        Real,
+        String,
+        Array,
+        Table,
+    };
+
+    template <class T>
+    struct ValueTypeOf;
+
+    template <>
+    struct ValueTypeOf<integer_t>
+    {
+        static constexpr ValueType value = ValueType::Integer;
+    };
+
+    template <>
+    struct ValueTypeOf<real_t>
+    {
+        static constexpr ValueType value = ValueType::Real;
+    };
+
+    template <>
+    struct ValueTypeOf<string_t>
+    {
+        static constexpr ValueType value = ValueType::String;
+    };
+
+    template <>
+    struct ValueTypeOf<array_t>
+    {
+        static constexpr ValueType value = ValueType::Array;
+    };
+
+    template <>
+    struct ValueTypeOf<table_t>
+    {
+        static constexpr ValueType value = ValueType::Table;
+    };
+
+    /// Type visitor
+    struct Visitor
+    {
+        ~Visitor() = default;
+        virtual void visit(const integer_t&) {}
+        virtual void visit(const real_t&) {}
+        virtual void visit(const string_t&) {}
+        virtual void visit(const array_t&) {}
+        virtual void visit(const table_t&) {}
+        virtual void visit(Null) {}
+
+        /// Elements of a homogeneous array, passed by one call.
+        /// By default, each element is visited one by one.
+        virtual void visit(span<const integer_t> s)
+        {
+            for (const auto& e : s)
+            {
+                visit(e);
+            }
+        }
+
+        virtual void visit(span<const real_t> s)
+        {
+            for (const auto& e : s)
+            {
+                visit(e);
+            }
+        }
+
+        virtual void visit(span<const string_t> s)
+        {
+            for (const auto& e : s)
+            {
+                visit(e);
+            }
+        }
+    };
+}
+
+#endif
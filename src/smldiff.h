@@ -0,0 +1,241 @@
+#ifndef SML_SMLDIFF_H
+#define SML_SMLDIFF_H
+
+#include "smldef.h"
+#include "smlobj.h"
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sml
+{
+    /// Paths of the values which differ between two documents.
+    /// A path joins keys by '.' and array indices by "[i]", such as "t_singer.cute[1].who".
+    /// Values of an added or removed path are not listed below it.
+    struct Diff
+    {
+        std::vector<std::string> added;
+        std::vector<std::string> removed;
+        std::vector<std::string> changed;
+
+        bool empty() const
+        {
+            return added.empty() && removed.empty() && changed.empty();
+        }
+    };
+
+    /// Options of diff.
+    struct DiffOptions
+    {
+        /// Split the entries of a table having at least this count of keys among threads.
+        /// Zero disables threads.
+        size_t parallelMinKeys = 4096;
+
+        /// Count of threads to use, or zero for the hardware concurrency.
+        unsigned threads = 0;
+    };
+
+    namespace detail
+    {
+        class Differ
+        {
+        private:
+            const DiffOptions& options_;
+
+        public:
+            explicit Differ(const DiffOptions& options)
+                : options_(options)
+            {
+            }
+
+            /// Tables below may be split among threads while 'parallel' is true.
+            void table(const std::string& path, const table_t& a, const table_t& b, Diff& out, bool parallel) const
+            {
+                if (&a == &b)
+                {
+                    return;
+                }
+
+                const auto threads = parallel ? threadCount((std::max)(a.length(), b.length())) : 1;
+                if (threads <= 1)
+                {
+                    if (a.hash() != b.hash())
+                    {
+                        entries(path, a, b, 0, 1, out, parallel);
+                    }
+                    return;
+                }
+
+                // Each thread takes every entry in its part of both tables.
+                // The hashes of this table are not computed, the threads hash their entries.
+                std::vector<std::future<Diff>> futures;
+                futures.reserve(threads - 1);
+                for (size_t t = 1; t < threads; ++t)
+                {
+                    futures.emplace_back(std::async(std::launch::async, [&, t] {
+                        Diff part;
+                        entries(path, a, b, t, threads, part, false);
+                        return part;
+                    }));
+                }
+
+                Diff first;
+                entries(path, a, b, 0, threads, first, false);
+                merge(out, first);
+                for (auto& f : futures)
+                {
+                    auto part = f.get();
+                    merge(out, part);
+                }
+            }
+
+        private:
+            size_t threadCount(size_t keys) const
+            {
+                if (options_.parallelMinKeys == 0 || keys < options_.parallelMinKeys)
+                {
+                    return 1;
+                }
+                const auto n = options_.threads != 0 ? options_.threads : std::thread::hardware_concurrency();
+                return std::max<size_t>(1, std::min<size_t>(n, keys * 4 / options_.parallelMinKeys));
+            }
+
+            /// Diff the entries in the part 't' of 'n' parts of both tables.
+            void entries(const std::string& path, const table_t& a, const table_t& b, size_t t, size_t n, Diff& out,
+                         bool parallel) const
+            {
+                const auto lo = [n, t](size_t len) { return len * t / n; };
+                const auto hi = [n, t](size_t len) { return len * (t + 1) / n; };
+
+                auto it = std::next(std::cbegin(a), lo(a.length()));
+                for (auto i = lo(a.length()); i < hi(a.length()); ++i, ++it)
+                {
+                    const auto e = *it;
+                    const auto other = b.find(e.first);
+                    if (!other)
+                    {
+                        out.removed.emplace_back(join(path, e.first));
+                    }
+                    else
+                    {
+                        value(join(path, e.first), e.second, *other, out, parallel);
+                    }
+                }
+
+                it = std::next(std::cbegin(b), lo(b.length()));
+                for (auto i = lo(b.length()); i < hi(b.length()); ++i, ++it)
+                {
+                    const auto e = *it;
+                    if (!a.contains(e.first))
+                    {
+                        out.added.emplace_back(join(path, e.first));
+                    }
+                }
+            }
+
+            void value(const std::string& path, const Value& a, const Value& b, Diff& out, bool parallel) const
+            {
+                if (&a == &b)
+                {
+                    return;
+                }
+                if (a.type() != b.type())
+                {
+                    out.changed.emplace_back(path);
+                    return;
+                }
+                if (a.type() == ValueType::Table)
+                {
+                    // Compares the hashes unless splitting among threads.
+                    table(path, static_cast<const table_t&>(a), static_cast<const table_t&>(b), out, parallel);
+                }
+                else if (structuralHash(a) == structuralHash(b))
+                {
+                    return;
+                }
+                else if (a.type() == ValueType::Array)
+                {
+                    array(path, static_cast<const array_t&>(a), static_cast<const array_t&>(b), out, parallel);
+                }
+                else
+                {
+                    out.changed.emplace_back(path);
+                }
+            }
+
+            void array(const std::string& path, const array_t& a, const array_t& b, Diff& out, bool parallel) const
+            {
+                const auto type = a.elementType();
+                if (type != b.elementType() || (type != ValueType::Array && type != ValueType::Table))
+                {
+                    out.changed.emplace_back(path);
+                    return;
+                }
+
+                const auto n = (std::min)(a.length(), b.length());
+                for (size_t i = 0; i < n; ++i)
+                {
+                    const auto& x = type == ValueType::Table ? static_cast<const Value&>(a.valueAs<table_t>(i))
+                                                             : static_cast<const Value&>(a.valueAs<array_t>(i));
+                    const auto& y = type == ValueType::Table ? static_cast<const Value&>(b.valueAs<table_t>(i))
+                                                             : static_cast<const Value&>(b.valueAs<array_t>(i));
+                    value(index(path, i), x, y, out, parallel);
+                }
+                for (auto i = n; i < a.length(); ++i)
+                {
+                    out.removed.emplace_back(index(path, i));
+                }
+                for (auto i = n; i < b.length(); ++i)
+                {
+                    out.added.emplace_back(index(path, i));
+                }
+            }
+
+            static std::string join(const std::string& path, const std::string& key)
+            {
+                return path.empty() ? key : path + "." + key;
+            }
+
+            static std::string index(const std::string& path, size_t i)
+            {
+                return path + "[" + std::to_string(i) + "]";
+            }
+
+            static void merge(Diff& out, Diff& part)
+            {
+                const auto append = [](std::vector<std::string>& to, std::vector<std::string>& from) {
+                    to.insert(std::cend(to), std::make_move_iterator(std::begin(from)), std::make_move_iterator(std::end(from)));
+                };
+                append(out.added, part.added);
+                append(out.removed, part.removed);
+                append(out.changed, part.changed);
+            }
+        };
+    }
+
+    /// Return the paths added, removed and changed from 'before' to 'after'.
+    /// Subtrees are skipped if they are the same node or their structural hashes are equal,
+    /// so the cost follows the size of the change once hashes are cached.
+    /// A changed array of integers, reals or strings is reported as a whole.
+    /// Reals compare by value, so 0.0 to -0.0 is not a change, nor is NaN to NaN.
+    inline Diff diff(const table_t& before, const table_t& after, const DiffOptions& options = DiffOptions())
+    {
+        Diff d;
+        detail::Differ(options).table(std::string(), before, after, d, true);
+        return d;
+    }
+
+    /// ditto
+    inline Diff diff(const std::shared_ptr<const table_t>& before, const std::shared_ptr<const table_t>& after,
+                     const DiffOptions& options = DiffOptions())
+    {
+        return diff(*before, *after, options);
+    }
+}
+
+#endif
@@ -0,0 +1,1461 @@
+#ifndef SML_SMLFROZEN_H
+#define SML_SMLFROZEN_H
+
+#include "smldef.h"
+#include "smlhash.h"
+#include "smlobj.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace sml
+{
+    /// Layout of a frozen document.
+    /// All references are byte offsets from the beginning of the block, so the block can be relocated.
+    namespace frozen
+    {
+        /// Tables and arrays begin at cache line boundaries.
+        constexpr size_t Align = 64;
+
+        constexpr uint32_t Magic = 0x464c4d53;        // "SMLF"
+        constexpr uint32_t MagicSwapped = 0x534d4c46; // Magic written in the other byte order
+        constexpr uint32_t Version = 4;
+        constexpr uint32_t ByteOrder = 0x01020304;
+
+        /// Build settings a block depends on. A block is read only by builds of the same layout.
+        struct Layout
+        {
+            uint32_t byteOrder;   // ByteOrder in the byte order of the writer
+            uint32_t version;     // Version
+            uint16_t integerSize; // sizeof(integer_t)
+            uint16_t realSize;    // sizeof(real_t)
+        };
+
+        /// Return the layout of this build.
+        constexpr Layout currentLayout()
+        {
+            return Layout{ ByteOrder, Version, static_cast<uint16_t>(sizeof(integer_t)), static_cast<uint16_t>(sizeof(real_t)) };
+        }
+
+        /// Throw ParseException if a block of the layout can not be read by this build.
+        inline void checkLayout(const Layout& layout)
+        {
+            if (layout.byteOrder != ByteOrder)
+            {
+                throw ParseException("Frozen document has another byte order.");
+            }
+            if (layout.version != Version)
+            {
+                throw ParseException("Unsupported frozen document version.");
+            }
+            if (layout.integerSize != sizeof(integer_t) || layout.realSize != sizeof(real_t))
+            {
+                throw ParseException("Frozen document has another size of integer_t or real_t.");
+            }
+        }
+
+        /// A value stored by a table entry or an array of strings, arrays or tables.
+        struct Slot
+        {
+            uint32_t type;   // ValueType
+            uint32_t length; // Length of a string
+            union
+            {
+                integer_t integer;
+                real_t real;
+                uint64_t offset; // Characters of a string, ArrayHeader or TableHeader
+            };
+        };
+
+        struct Entry
+        {
+            uint64_t key; // Offset of characters
+            uint32_t keyLength;
+            uint32_t hash; // Low bits of the key hash if the table is perfectly hashed
+            Slot value;
+        };
+
+        /// Followed by Entry[count],
+        /// sorted by key or placed by the perfect hash if there is.
+        struct TableHeader
+        {
+            uint64_t count;
+            uint64_t hash; // PerfectHash, or 0 if there is not
+        };
+
+        /// Minimal perfect hash of keys of a table, by hash and displace.
+        /// A key hashed with 'seed' selects a bucket by the high bits,
+        /// then the displacement of the bucket and the low bits select the entry.
+        /// Followed by uint32_t displacements[buckets].
+        struct PerfectHash
+        {
+            uint64_t seed;
+            uint64_t buckets;
+        };
+
+        inline uint64_t bucketOf(uint64_t h, uint64_t buckets)
+        {
+            return ((h >> 32) * buckets) >> 32;
+        }
+
+        inline uint64_t entryOf(uint64_t h, uint32_t displacement, uint64_t count)
+        {
+            const auto x = static_cast<uint32_t>(h) ^ static_cast<uint32_t>(hashMix(displacement + 1));
+            return (static_cast<uint64_t>(x) * count) >> 32;
+        }
+
+        struct ArrayHeader
+        {
+            uint32_t elementType; // ValueType
+            uint32_t rank;        // Dimensions from this array if packed, otherwise 0
+            uint64_t count;
+            uint64_t data;    // integer_t[count], real_t[count] or Slot[count]
+            uint64_t dense;   // First element of the packed buffer
+            uint64_t shape;   // uint64_t[rank]
+            uint64_t strides; // uint64_t[rank]
+        };
+
+        /// Beginning of the block
+        struct Header
+        {
+            uint32_t magic;
+            Layout layout;
+            uint64_t size;     // Bytes of the whole block
+            uint64_t root;     // TableHeader
+            uint64_t checksum; // hashBytes() of the bytes after this header
+        };
+
+        template <class T>
+        const T* at(const unsigned char* base, uint64_t offset)
+        {
+            return reinterpret_cast<const T*>(base + offset);
+        }
+    }
+
+    class FrozenTable;
+    class FrozenArray;
+
+    /// Type of values read from a frozen document as a 'T' type
+    template <class T>
+    struct FrozenType
+    {
+        using type = const T&;
+    };
+
+    template <>
+    struct FrozenType<string_t>
+    {
+        using type = std::string_view;
+    };
+
+    template <>
+    struct FrozenType<array_t>
+    {
+        using type = FrozenArray;
+    };
+
+    template <>
+    struct FrozenType<table_t>
+    {
+        using type = FrozenTable;
+    };
+
+    template <class T>
+    using FrozenType_t = typename FrozenType<T>::type;
+
+    namespace frozen
+    {
+        // Read the slot as a 'T' type without checking the type.
+        inline const integer_t& read(const unsigned char*, const Slot& s, TypeTag<integer_t>);
+        inline const real_t& read(const unsigned char*, const Slot& s, TypeTag<real_t>);
+        inline std::string_view read(const unsigned char* base, const Slot& s, TypeTag<string_t>);
+        inline FrozenArray read(const unsigned char* base, const Slot& s, TypeTag<array_t>);
+        inline FrozenTable read(const unsigned char* base, const Slot& s, TypeTag<table_t>);
+    }
+
+    /// Read only handle of a value inside a frozen document.
+    /// Handles do not own the document, it needs to outlive them.
+    class FrozenValue
+    {
+    private:
+        const unsigned char* base_;
+        const frozen::Slot* slot_;
+
+    public:
+        FrozenValue(const unsigned char* base, const frozen::Slot* slot)
+            : base_(base)
+            , slot_(slot)
+        {
+        }
+
+        /// Return the type tag of this value.
+        ValueType type() const
+        {
+            return static_cast<ValueType>(slot_->type);
+        }
+
+        /// Return true if the type of this value is 'T'.
+        template <class T>
+        bool is() const
+        {
+            return type() == ValueTypeOf<T>::value;
+        }
+
+        /// Return this value as a 'T' type.
+        template <class T>
+        FrozenType_t<T> as() const
+        {
+            if (!is<T>())
+            {
+                throw MismatchType();
+            }
+            return frozen::read(base_, *slot_, TypeTag<T>());
+        }
+    };
+
+    /// Range over the string, array or table elements of a frozen array.
+    template <class T>
+    class FrozenRange
+    {
+    private:
+        const unsigned char* base_;
+        const frozen::Slot* begin_;
+        const frozen::Slot* end_;
+
+    public:
+        class const_iterator
+        {
+        private:
+            const unsigned char* base_ = nullptr;
+            const frozen::Slot* it_ = nullptr;
+
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = FrozenType_t<T>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = value_type;
+
+            const_iterator() = default;
+
+            const_iterator(const unsigned char* base, const frozen::Slot* it)
+                : base_(base)
+                , it_(it)
+            {
+            }
+
+            value_type operator*() const
+            {
+                return frozen::read(base_, *it_, TypeTag<T>());
+            }
+
+            const_iterator& operator++()
+            {
+                ++it_;
+                return *this;
+            }
+
+            const_iterator operator++(int)
+            {
+                const auto tmp = *this;
+                ++it_;
+                return tmp;
+            }
+
+            bool operator==(const const_iterator& rhs) const
+            {
+                return it_ == rhs.it_;
+            }
+
+            bool operator!=(const const_iterator& rhs) const
+            {
+                return it_ != rhs.it_;
+            }
+        };
+
+        FrozenRange(const unsigned char* base, const frozen::Slot* b, const frozen::Slot* e)
+            : base_(base)
+            , begin_(b)
+            , end_(e)
+        {
+        }
+
+        const_iterator begin() const
+        {
+            return const_iterator(base_, begin_);
+        }
+
+        const_iterator end() const
+        {
+            return const_iterator(base_, end_);
+        }
+
+        FrozenType_t<T> operator[](size_t i) const
+        {
+            return frozen::read(base_, begin_[i], TypeTag<T>());
+        }
+
+        /// Return the count of elements.
+        size_t size() const
+        {
+            return end_ - begin_;
+        }
+
+        bool empty() const
+        {
+            return begin_ == end_;
+        }
+    };
+
+    template <class T>
+    struct FrozenRangeOf
+    {
+        using type = span<const T>;
+    };
+
+    template <>
+    struct FrozenRangeOf<string_t>
+    {
+        using type = FrozenRange<string_t>;
+    };
+
+    template <>
+    struct FrozenRangeOf<array_t>
+    {
+        using type = FrozenRange<array_t>;
+    };
+
+    template <>
+    struct FrozenRangeOf<table_t>
+    {
+        using type = FrozenRange<table_t>;
+    };
+
+    /// Range over the elements of a frozen array as a 'T' type.
+    template <class T>
+    using FrozenRange_t = typename FrozenRangeOf<T>::type;
+
+    /// Read only handle of an array inside a frozen document, with the read API of array_t.
+    class FrozenArray
+    {
+    private:
+        const unsigned char* base_ = nullptr;
+        const frozen::ArrayHeader* header_ = nullptr;
+
+    public:
+        FrozenArray() = default;
+
+        FrozenArray(const unsigned char* base, const frozen::ArrayHeader* header)
+            : base_(base)
+            , header_(header)
+        {
+        }
+
+        /// Return the size of this array
+        size_t length() const
+        {
+            return static_cast<size_t>(header_->count);
+        }
+
+        /// Return the type tag of elements, or ValueType::Null if this array is empty.
+        ValueType elementType() const
+        {
+            return static_cast<ValueType>(header_->elementType);
+        }
+
+        /// Return true if the array type is 'T'.
+        template <class T>
+        bool arrayIs() const
+        {
+            return elementType() == ValueTypeOf<T>::value;
+        }
+
+        /// Return the indexed value as a 'T' type.
+        template <class T>
+        FrozenType_t<T> valueAs(size_t i) const
+        {
+            if (!arrayIs<T>())
+            {
+                throw MismatchType();
+            }
+            if (i >= length())
+            {
+                throw std::out_of_range("array index out of range");
+            }
+            return elements(TypeTag<T>())[i];
+        }
+
+        /// Return the range of all elements as a 'T' type.
+        template <class T>
+        FrozenRange_t<T> as() const
+        {
+            if (elementType() != ValueType::Null && !arrayIs<T>())
+            {
+                throw MismatchType();
+            }
+            return elements(TypeTag<T>());
+        }
+
+        /// Copy all elements as a 'T' type into the buffer, converting each to 'Out'.
+        template <class T, size_t Align = 0, class Out>
+        void copyTo(Out* out) const
+        {
+            const auto src = as<T>();
+            const auto d = assumeAligned<Align>(out);
+            for (size_t i = 0; i < src.size(); ++i)
+            {
+                d[i] = static_cast<Out>(src[i]);
+            }
+        }
+
+        /// Return all elements as a vector of 'T'.
+        template <class T>
+        std::vector<T> toVector() const
+        {
+            std::vector<T> v(length());
+            copyTo<SourceType_t<T>>(v.data());
+            return v;
+        }
+
+        /// Return true if this array is packed into a contiguous buffer.
+        bool packed() const
+        {
+            return header_->rank > 0;
+        }
+
+        /// Return the N-dimensional view of a packed array of 'T'.
+        template <class T>
+        NDView<T> ndview() const
+        {
+            static_assert(sizeof(size_t) == sizeof(uint64_t), "frozen shapes are stored as 64-bit integers");
+
+            if (!packed() || leafType() != ValueTypeOf<T>::value)
+            {
+                throw MismatchType();
+            }
+            const auto rank = header_->rank;
+            return NDView<T>(frozen::at<T>(base_, header_->dense),
+                             span<const size_t>(frozen::at<size_t>(base_, header_->shape), rank),
+                             span<const size_t>(frozen::at<size_t>(base_, header_->strides), rank));
+        }
+
+    private:
+        ValueType leafType() const
+        {
+            auto h = header_;
+            while (static_cast<ValueType>(h->elementType) == ValueType::Array)
+            {
+                h = frozen::at<frozen::ArrayHeader>(base_, frozen::at<frozen::Slot>(base_, h->data)->offset);
+            }
+            return static_cast<ValueType>(h->elementType);
+        }
+
+        span<const integer_t> elements(TypeTag<integer_t>) const
+        {
+            return span<const integer_t>(frozen::at<integer_t>(base_, header_->data), length());
+        }
+
+        span<const real_t> elements(TypeTag<real_t>) const
+        {
+            return span<const real_t>(frozen::at<real_t>(base_, header_->data), length());
+        }
+
+        template <class T>
+        FrozenRange<T> elements(TypeTag<T>) const
+        {
+            const auto slots = frozen::at<frozen::Slot>(base_, header_->data);
+            return FrozenRange<T>(base_, slots, slots + length());
+        }
+    };
+
+    /// Read only handle of a table inside a frozen document, with the read API of table_t.
+    /// Strings are read as std::string_view, arrays and tables as handles.
+    class FrozenTable
+    {
+    private:
+        const unsigned char* base_ = nullptr;
+        const frozen::TableHeader* header_ = nullptr;
+
+    public:
+        /// Iterator over pairs of a key and a value mapped by it,
+        /// in key order, or in hash order if the table is perfectly hashed.
+        class const_iterator
+        {
+        private:
+            const unsigned char* base_ = nullptr;
+            const frozen::Entry* it_ = nullptr;
+
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::pair<std::string_view, FrozenValue>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = value_type;
+
+            const_iterator() = default;
+
+            const_iterator(const unsigned char* base, const frozen::Entry* it)
+                : base_(base)
+                , it_(it)
+            {
+            }
+
+            value_type operator*() const
+            {
+                return value_type(std::string_view(frozen::at<char>(base_, it_->key), it_->keyLength),
+                                  FrozenValue(base_, &it_->value));
+            }
+
+            const_iterator& operator++()
+            {
+                ++it_;
+                return *this;
+            }
+
+            const_iterator operator++(int)
+            {
+                const auto tmp = *this;
+                ++it_;
+                return tmp;
+            }
+
+            bool operator==(const const_iterator& rhs) const
+            {
+                return it_ == rhs.it_;
+            }
+
+            bool operator!=(const const_iterator& rhs) const
+            {
+                return it_ != rhs.it_;
+            }
+        };
+
+        FrozenTable() = default;
+
+        FrozenTable(const unsigned char* base, const frozen::TableHeader* header)
+            : base_(base)
+            , header_(header)
+        {
+        }
+
+        const_iterator begin() const
+        {
+            return const_iterator(base_, entries());
+        }
+
+        const_iterator end() const
+        {
+            return const_iterator(base_, entries() + length());
+        }
+
+        /// Whether this table contains the key.
+        bool contains(std::string_view key) const
+        {
+            return !!find(key);
+        }
+
+        /// Count of keys.
+        size_t length() const
+        {
+            return static_cast<size_t>(header_->count);
+        }
+
+        /// From the key inside the table, return a mapped value as a 'T' type.
+        /// If 'T' is a std::vector, the mapped array is converted to a new vector in bulk.
+        template <class T>
+        std::conditional_t<IsVector<T>::value, T, FrozenType_t<T>> valueAs(std::string_view key) const
+        {
+            if constexpr (IsVector<T>::value)
+            {
+                return valueAs<array_t>(key).template toVector<typename T::value_type>();
+            }
+            else
+            {
+                const auto slot = find(key);
+                if (!slot)
+                {
+                    throw KeyNotFound();
+                }
+                if (slot->type != static_cast<uint32_t>(ValueTypeOf<T>::value))
+                {
+                    throw MismatchType();
+                }
+                return frozen::read(base_, *slot, TypeTag<T>());
+            }
+        }
+
+        /// Return true if the type of a value mapped by the key inside the table is 'T'.
+        /// The case of type mismatch or the key is not exists, return false.
+        template <class T>
+        bool valueIs(std::string_view key) const
+        {
+            const auto slot = find(key);
+            return slot && slot->type == static_cast<uint32_t>(ValueTypeOf<T>::value);
+        }
+
+    private:
+        const frozen::Entry* entries() const
+        {
+            return reinterpret_cast<const frozen::Entry*>(header_ + 1);
+        }
+
+        std::string_view keyOf(const frozen::Entry& e) const
+        {
+            return std::string_view(frozen::at<char>(base_, e.key), e.keyLength);
+        }
+
+        const frozen::Slot* find(std::string_view key) const
+        {
+            if (header_->hash)
+            {
+                // One probe and one key comparison.
+                const auto ph = frozen::at<frozen::PerfectHash>(base_, header_->hash);
+                const auto displacements = reinterpret_cast<const uint32_t*>(ph + 1);
+                const auto h = hashBytes(key.data(), key.size(), ph->seed);
+                const auto& e = entries()[frozen::entryOf(h, displacements[frozen::bucketOf(h, ph->buckets)], length())];
+                if (e.hash == static_cast<uint32_t>(h) && keyOf(e) == key)
+                {
+                    return &e.value;
+                }
+                return nullptr;
+            }
+
+            const auto b = entries();
+            const auto e = b + length();
+            const auto found = std::lower_bound(b, e, key, [&](const frozen::Entry& entry, std::string_view k) {
+                return keyOf(entry) < k;
+            });
+            if (found != e && keyOf(*found) == key)
+            {
+                return &found->value;
+            }
+            return nullptr;
+        }
+    };
+
+    namespace frozen
+    {
+        inline const integer_t& read(const unsigned char*, const Slot& s, TypeTag<integer_t>)
+        {
+            return s.integer;
+        }
+
+        inline const real_t& read(const unsigned char*, const Slot& s, TypeTag<real_t>)
+        {
+            return s.real;
+        }
+
+        inline std::string_view read(const unsigned char* base, const Slot& s, TypeTag<string_t>)
+        {
+            return std::string_view(at<char>(base, s.offset), s.length);
+        }
+
+        inline FrozenArray read(const unsigned char* base, const Slot& s, TypeTag<array_t>)
+        {
+            return FrozenArray(base, at<ArrayHeader>(base, s.offset));
+        }
+
+        inline FrozenTable read(const unsigned char* base, const Slot& s, TypeTag<table_t>)
+        {
+            return FrozenTable(base, at<TableHeader>(base, s.offset));
+        }
+
+        /// Checks that every offset of a block lies inside it, aligned for what it refers,
+        /// so that handles never read outside the block. Nodes are walked without recursion.
+        /// The writer places each table and array after the node referring it, and each
+        /// node is read at most twice, so a broken block can neither loop nor take long.
+        class Checker
+        {
+        private:
+            struct Node
+            {
+                ValueType type;
+                uint64_t offset;
+                uint32_t rank; // Expected rank of a row of a packed array, otherwise 0
+                ValueType leaf;
+            };
+
+            const unsigned char* base_;
+            uint64_t size_;
+            uint64_t budget_;
+            std::vector<Node> work_;
+
+        public:
+            Checker(const unsigned char* base, uint64_t size)
+                : base_(base)
+                , size_(size)
+                , budget_(size / Align * 2 + 2)
+            {
+            }
+
+            /// Return true if all nodes reachable from the root table are well formed.
+            bool run(uint64_t root)
+            {
+                work_.push_back(Node{ ValueType::Table, root, 0, ValueType::Null });
+                while (!work_.empty())
+                {
+                    const auto node = work_.back();
+                    work_.pop_back();
+                    if (!spend() || !(node.type == ValueType::Table ? table(node.offset) : array(node)))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+        private:
+            bool spend()
+            {
+                if (budget_ == 0)
+                {
+                    return false;
+                }
+                --budget_;
+                return true;
+            }
+
+            /// Whether 'count' items of 'itemSize' bytes at the offset lie inside the block.
+            bool inside(uint64_t offset, uint64_t count, uint64_t itemSize, uint64_t align) const
+            {
+                return offset % align == 0 && offset <= size_ && count <= (size_ - offset) / itemSize;
+            }
+
+            bool slot(const Slot& s, uint64_t parent, uint32_t rank = 0, ValueType leaf = ValueType::Null)
+            {
+                switch (static_cast<ValueType>(s.type))
+                {
+                case ValueType::Null:
+                case ValueType::Integer:
+                case ValueType::Real:
+                    return true;
+                case ValueType::String:
+                    return inside(s.offset, s.length, 1, 1);
+                case ValueType::Array:
+                case ValueType::Table:
+                    if (s.offset <= parent)
+                    {
+                        return false;
+                    }
+                    work_.push_back(Node{ static_cast<ValueType>(s.type), s.offset, rank, leaf });
+                    return true;
+                default:
+                    return false;
+                }
+            }
+
+            bool table(uint64_t offset)
+            {
+                if (!inside(offset, 1, sizeof(TableHeader), Align))
+                {
+                    return false;
+                }
+                const auto h = at<TableHeader>(base_, offset);
+                if (!inside(offset + sizeof(TableHeader), h->count, sizeof(Entry), alignof(Entry)))
+                {
+                    return false;
+                }
+                if (h->hash)
+                {
+                    if (h->count == 0 || !inside(h->hash, 1, sizeof(PerfectHash), alignof(PerfectHash)))
+                    {
+                        return false;
+                    }
+                    const auto ph = at<PerfectHash>(base_, h->hash);
+                    if (ph->buckets == 0 || !inside(h->hash + sizeof(PerfectHash), ph->buckets, sizeof(uint32_t), alignof(uint32_t)))
+                    {
+                        return false;
+                    }
+                }
+
+                const auto entries = reinterpret_cast<const Entry*>(h + 1);
+                for (uint64_t i = 0; i < h->count; ++i)
+                {
+                    if (!inside(entries[i].key, entries[i].keyLength, 1, 1) || !slot(entries[i].value, offset))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            bool array(const Node& node)
+            {
+                if (!inside(node.offset, 1, sizeof(ArrayHeader), Align))
+                {
+                    return false;
+                }
+                const auto h = at<ArrayHeader>(base_, node.offset);
+                if (node.rank != 0 && h->rank != node.rank)
+                {
+                    return false;
+                }
+
+                const auto type = static_cast<ValueType>(h->elementType);
+                switch (type)
+                {
+                case ValueType::Null:
+                    if (h->count != 0)
+                    {
+                        return false;
+                    }
+                    break;
+                case ValueType::Integer:
+                    if (!inside(h->data, h->count, sizeof(integer_t), alignof(integer_t)))
+                    {
+                        return false;
+                    }
+                    break;
+                case ValueType::Real:
+                    if (!inside(h->data, h->count, sizeof(real_t), alignof(real_t)))
+                    {
+                        return false;
+                    }
+                    break;
+                case ValueType::String:
+                case ValueType::Array:
+                case ValueType::Table:
+                    if (!inside(h->data, h->count, sizeof(Slot), alignof(Slot)))
+                    {
+                        return false;
+                    }
+                    break;
+                default:
+                    return false;
+                }
+
+                auto leaf = node.leaf;
+                if (h->rank > 0)
+                {
+                    if (leaf == ValueType::Null)
+                    {
+                        leaf = leafOf(node.offset);
+                    }
+                    if (!packed(*h, leaf))
+                    {
+                        return false;
+                    }
+                }
+
+                if (type == ValueType::String || type == ValueType::Array || type == ValueType::Table)
+                {
+                    const auto slots = at<Slot>(base_, h->data);
+                    const auto rank = h->rank > 0 ? h->rank - 1 : 0;
+                    for (uint64_t i = 0; i < h->count; ++i)
+                    {
+                        if (slots[i].type != h->elementType || !slot(slots[i], node.offset, rank, rank > 0 ? leaf : ValueType::Null))
+                        {
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            }
+
+            /// Follow the first rows down to the numbers as FrozenArray::ndview() does.
+            /// Return ValueType::Null if the rows are broken.
+            ValueType leafOf(uint64_t offset)
+            {
+                for (;;)
+                {
+                    const auto h = at<ArrayHeader>(base_, offset);
+                    const auto type = static_cast<ValueType>(h->elementType);
+                    if (type != ValueType::Array)
+                    {
+                        return h->rank == 1 ? type : ValueType::Null;
+                    }
+                    if (h->rank < 2 || h->count == 0 || !inside(h->data, 1, sizeof(Slot), alignof(Slot)) || !spend())
+                    {
+                        return ValueType::Null;
+                    }
+                    const auto child = at<Slot>(base_, h->data)->offset;
+                    if (child <= offset || !inside(child, 1, sizeof(ArrayHeader), Align) || at<ArrayHeader>(base_, child)->rank != h->rank - 1)
+                    {
+                        return ValueType::Null;
+                    }
+                    offset = child;
+                }
+            }
+
+            /// Whether the packed buffer lies inside the block, in row major order as NDView reads it.
+            bool packed(const ArrayHeader& h, ValueType leaf) const
+            {
+                if (leaf != ValueType::Integer && leaf != ValueType::Real)
+                {
+                    return false;
+                }
+                const auto expected = h.rank == 1 ? leaf : ValueType::Array;
+                if (static_cast<ValueType>(h.elementType) != expected || (h.rank > 1 && h.count == 0))
+                {
+                    return false;
+                }
+                if (!inside(h.shape, h.rank, sizeof(uint64_t), alignof(uint64_t)) ||
+                    !inside(h.strides, h.rank, sizeof(uint64_t), alignof(uint64_t)))
+                {
+                    return false;
+                }
+
+                const auto shape = at<uint64_t>(base_, h.shape);
+                const auto strides = at<uint64_t>(base_, h.strides);
+                uint64_t count = 1;
+                for (auto d = h.rank; d-- > 0;)
+                {
+                    if (strides[d] != count || (shape[d] != 0 && count > size_ / shape[d]))
+                    {
+                        return false;
+                    }
+                    count *= shape[d];
+                }
+                const auto elementSize = leaf == ValueType::Integer ? sizeof(integer_t) : sizeof(real_t);
+                return inside(h.dense, count, elementSize, elementSize);
+            }
+        };
+
+        /// Lays a document out in depth first order.
+        /// Each table is followed by its keys and strings, then by its children.
+        class Writer
+        {
+        private:
+            std::vector<unsigned char> buf_;
+            size_t perfectHashMinKeys_;
+
+        public:
+            /// Tables with at least 'perfectHashMinKeys' keys are perfectly hashed, 0 disables it.
+            explicit Writer(size_t perfectHashMinKeys = 0)
+                : perfectHashMinKeys_(perfectHashMinKeys)
+            {
+            }
+
+            std::vector<unsigned char> write(const table_t& root)
+            {
+                buf_.clear();
+                const auto header = allocate(sizeof(Header), Align);
+                const auto rootOffset = writeTable(root);
+
+                const auto h = at<Header>(header);
+                h->magic = Magic;
+                h->layout = currentLayout();
+                h->size = buf_.size();
+                h->root = rootOffset;
+                h->checksum = hashBytes(buf_.data() + sizeof(Header), buf_.size() - sizeof(Header));
+                return std::move(buf_);
+            }
+
+        private:
+            template <class T>
+            T* at(uint64_t offset)
+            {
+                return reinterpret_cast<T*>(buf_.data() + offset);
+            }
+
+            uint64_t allocate(size_t size, size_t align)
+            {
+                const auto offset = (buf_.size() + align - 1) / align * align;
+                buf_.resize(offset + size);
+                return offset;
+            }
+
+            uint64_t writeChars(const char* s, size_t n)
+            {
+                const auto offset = allocate(n + 1, 1);
+                std::memcpy(buf_.data() + offset, s, n);
+                buf_[offset + n] = '\0';
+                return offset;
+            }
+
+            uint64_t writeTable(const table_t& table)
+            {
+                std::vector<std::pair<std::string_view, const Value*>> entries;
+                entries.reserve(table.length());
+                for (const auto e : table)
+                {
+                    entries.emplace_back(e.first, &e.second);
+                }
+                std::sort(std::begin(entries), std::end(entries), [](const auto& a, const auto& b) {
+                    return a.first < b.first;
+                });
+
+                const auto offset = allocate(sizeof(TableHeader) + sizeof(Entry) * entries.size(), Align);
+                at<TableHeader>(offset)->count = entries.size();
+                at<TableHeader>(offset)->hash = 0;
+
+                std::vector<uint32_t> hashes(entries.size(), 0);
+                if (perfectHashMinKeys_ > 0 && entries.size() >= perfectHashMinKeys_)
+                {
+                    const auto ph = writePerfectHash(entries, hashes);
+                    at<TableHeader>(offset)->hash = ph;
+                }
+
+                const auto entry = [&](size_t i) {
+                    return at<Entry>(offset + sizeof(TableHeader) + sizeof(Entry) * i);
+                };
+
+                // Keys and strings first, to keep them close to the entries.
+                for (size_t i = 0; i < entries.size(); ++i)
+                {
+                    const auto key = writeChars(entries[i].first.data(), entries[i].first.size());
+                    entry(i)->key = key;
+                    entry(i)->keyLength = static_cast<uint32_t>(entries[i].first.size());
+                    entry(i)->hash = hashes[i];
+                    writeScalar(offset + sizeof(TableHeader) + sizeof(Entry) * i + offsetof(Entry, value), *entries[i].second);
+                }
+                for (size_t i = 0; i < entries.size(); ++i)
+                {
+                    writeNode(offset + sizeof(TableHeader) + sizeof(Entry) * i + offsetof(Entry, value), *entries[i].second);
+                }
+                return offset;
+            }
+
+            /// Build the perfect hash of the keys and reorder the entries by it.
+            /// Buckets are filled from the largest, each trying displacements until its keys land on free entries.
+            /// If a bucket can not be placed, retry with the next seed.
+            template <class Entries>
+            uint64_t writePerfectHash(Entries& entries, std::vector<uint32_t>& hashes)
+            {
+                const auto n = entries.size();
+                const auto buckets = (n + 3) / 4;
+                std::vector<uint64_t> h(n);
+                std::vector<std::vector<size_t>> members(buckets);
+                std::vector<size_t> order(buckets);
+                std::vector<uint32_t> displacements(buckets);
+                std::vector<size_t> placed(n);
+                std::vector<bool> taken(n);
+                std::vector<uint64_t> positions;
+
+                for (uint64_t seed = 1;; ++seed)
+                {
+                    for (auto& m : members)
+                    {
+                        m.clear();
+                    }
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        h[i] = hashBytes(entries[i].first.data(), entries[i].first.size(), seed);
+                        members[bucketOf(h[i], buckets)].emplace_back(i);
+                    }
+                    for (size_t b = 0; b < buckets; ++b)
+                    {
+                        order[b] = b;
+                    }
+                    std::sort(std::begin(order), std::end(order), [&](size_t a, size_t b) {
+                        return members[a].size() > members[b].size();
+                    });
+                    std::fill(std::begin(taken), std::end(taken), false);
+
+                    bool ok = true;
+                    for (const auto b : order)
+                    {
+                        if (members[b].empty())
+                        {
+                            displacements[b] = 0;
+                            continue;
+                        }
+
+                        // The last buckets need about n tries to find the last free entries.
+                        const auto tries = std::min<uint64_t>(UINT32_MAX, std::max<uint64_t>(1u << 16, n * 64));
+                        bool found = false;
+                        for (uint64_t d = 0; d < tries && !found; ++d)
+                        {
+                            positions.clear();
+                            found = true;
+                            for (const auto i : members[b])
+                            {
+                                const auto pos = entryOf(h[i], static_cast<uint32_t>(d), n);
+                                if (taken[pos] || std::find(std::cbegin(positions), std::cend(positions), pos) != std::cend(positions))
+                                {
+                                    found = false;
+                                    break;
+                                }
+                                positions.emplace_back(pos);
+                            }
+                            if (found)
+                            {
+                                displacements[b] = static_cast<uint32_t>(d);
+                                for (size_t k = 0; k < positions.size(); ++k)
+                                {
+                                    taken[positions[k]] = true;
+                                    placed[positions[k]] = members[b][k];
+                                }
+                            }
+                        }
+                        if (!found)
+                        {
+                            ok = false;
+                            break;
+                        }
+                    }
+                    if (!ok)
+                    {
+                        continue;
+                    }
+
+                    Entries reordered;
+                    reordered.reserve(n);
+                    for (size_t pos = 0; pos < n; ++pos)
+                    {
+                        reordered.emplace_back(entries[placed[pos]]);
+                        hashes[pos] = static_cast<uint32_t>(h[placed[pos]]);
+                    }
+                    entries = std::move(reordered);
+
+                    const auto offset = allocate(sizeof(PerfectHash) + sizeof(uint32_t) * buckets, alignof(PerfectHash));
+                    at<PerfectHash>(offset)->seed = seed;
+                    at<PerfectHash>(offset)->buckets = buckets;
+                    std::memcpy(buf_.data() + offset + sizeof(PerfectHash), displacements.data(), sizeof(uint32_t) * buckets);
+                    return offset;
+                }
+            }
+
+            void writeScalar(uint64_t slotOffset, const Value& val)
+            {
+                Slot slot;
+                std::memset(&slot, 0, sizeof(slot));
+                slot.type = static_cast<uint32_t>(val.type());
+                switch (val.type())
+                {
+                case ValueType::Integer:
+                    slot.integer = valueAs<integer_t>(val);
+                    break;
+                case ValueType::Real:
+                    slot.real = valueAs<real_t>(val);
+                    break;
+                case ValueType::String:
+                {
+                    const auto& s = valueAs<string_t>(val);
+                    slot.length = static_cast<uint32_t>(s.size());
+                    slot.offset = writeChars(s.data(), s.size());
+                    break;
+                }
+                default:
+                    break;
+                }
+                std::memcpy(buf_.data() + slotOffset, &slot, sizeof(slot));
+            }
+
+            void writeNode(uint64_t slotOffset, const Value& val)
+            {
+                uint64_t child = 0;
+                if (val.type() == ValueType::Array)
+                {
+                    child = writeArray(static_cast<const array_t&>(val));
+                }
+                else if (val.type() == ValueType::Table)
+                {
+                    child = writeTable(static_cast<const table_t&>(val));
+                }
+                else
+                {
+                    return;
+                }
+                at<Slot>(slotOffset)->offset = child;
+            }
+
+            uint64_t writeArray(const array_t& arr)
+            {
+                if (arr.packed())
+                {
+                    return writePacked(arr);
+                }
+
+                const auto offset = allocate(sizeof(ArrayHeader), Align);
+                const auto type = arr.elementType();
+                const auto n = arr.length();
+                uint64_t data = 0;
+
+                switch (type)
+                {
+                case ValueType::Integer:
+                    data = writeNumbers(arr.as<integer_t>());
+                    break;
+                case ValueType::Real:
+                    data = writeNumbers(arr.as<real_t>());
+                    break;
+                case ValueType::String:
+                {
+                    data = allocate(sizeof(Slot) * n, alignof(Slot));
+                    std::memset(buf_.data() + data, 0, sizeof(Slot) * n);
+                    size_t i = 0;
+                    for (const auto& s : arr.as<string_t>())
+                    {
+                        const auto chars = writeChars(s.data(), s.size());
+                        const auto slot = at<Slot>(data + sizeof(Slot) * i++);
+                        slot->type = static_cast<uint32_t>(ValueType::String);
+                        slot->length = static_cast<uint32_t>(s.size());
+                        slot->offset = chars;
+                    }
+                    break;
+                }
+                case ValueType::Array:
+                    data = writeNodes(arr.as<array_t>());
+                    break;
+                case ValueType::Table:
+                    data = writeNodes(arr.as<table_t>());
+                    break;
+                default:
+                    break;
+                }
+
+                const auto h = at<ArrayHeader>(offset);
+                h->elementType = static_cast<uint32_t>(type);
+                h->rank = 0;
+                h->count = n;
+                h->data = data;
+                h->dense = 0;
+                h->shape = 0;
+                h->strides = 0;
+                return offset;
+            }
+
+            template <class Range>
+            uint64_t writeNumbers(const Range& range)
+            {
+                using T = std::remove_cv_t<std::remove_reference_t<decltype(range[0])>>;
+                const auto offset = allocate(sizeof(T) * range.size(), alignof(T));
+                if (!range.empty())
+                {
+                    std::memcpy(buf_.data() + offset, range.data(), sizeof(T) * range.size());
+                }
+                return offset;
+            }
+
+            template <class Range>
+            uint64_t writeNodes(const Range& range)
+            {
+                const auto offset = allocate(sizeof(Slot) * range.size(), alignof(Slot));
+                std::memset(buf_.data() + offset, 0, sizeof(Slot) * range.size());
+                size_t i = 0;
+                for (const auto& e : range)
+                {
+                    const auto slotOffset = offset + sizeof(Slot) * i++;
+                    at<Slot>(slotOffset)->type = static_cast<uint32_t>(e.type());
+                    writeNode(slotOffset, e);
+                }
+                return offset;
+            }
+
+            /// The packed buffer is written once, then the rows are written as views of it.
+            uint64_t writePacked(const array_t& arr)
+            {
+                const auto integers = arr.elementType() == ValueType::Integer ||
+                    (arr.elementType() == ValueType::Array && leafIsInteger(arr));
+
+                uint64_t dense = 0;
+                size_t rank = 0;
+                std::vector<uint64_t> shape;
+                std::vector<uint64_t> strides;
+                if (integers)
+                {
+                    const auto view = arr.ndview<integer_t>();
+                    dense = writeNumbers(span<const integer_t>(view.data(), view.size()));
+                    rank = view.rank();
+                    shape.assign(std::cbegin(view.shape()), std::cend(view.shape()));
+                    strides.assign(std::cbegin(view.strides()), std::cend(view.strides()));
+                }
+                else
+                {
+                    const auto view = arr.ndview<real_t>();
+                    dense = writeNumbers(span<const real_t>(view.data(), view.size()));
+                    rank = view.rank();
+                    shape.assign(std::cbegin(view.shape()), std::cend(view.shape()));
+                    strides.assign(std::cbegin(view.strides()), std::cend(view.strides()));
+                }
+
+                const auto dims = allocate(sizeof(uint64_t) * rank * 2, alignof(uint64_t));
+                std::memcpy(buf_.data() + dims, shape.data(), sizeof(uint64_t) * rank);
+                std::memcpy(buf_.data() + dims + sizeof(uint64_t) * rank, strides.data(), sizeof(uint64_t) * rank);
+
+                return writeView(integers ? ValueType::Integer : ValueType::Real, dense, dims, rank, 0);
+            }
+
+            uint64_t writeView(ValueType leaf, uint64_t dense, uint64_t dims, size_t rank, size_t dim)
+            {
+                const auto elementSize = leaf == ValueType::Integer ? sizeof(integer_t) : sizeof(real_t);
+                const auto shape = at<uint64_t>(dims);
+                const auto strides = at<uint64_t>(dims + sizeof(uint64_t) * rank);
+                const auto n = shape[dim];
+                const auto stride = strides[dim];
+
+                const auto offset = allocate(sizeof(ArrayHeader), Align);
+                uint64_t data = dense;
+                if (dim + 1 < rank)
+                {
+                    data = allocate(sizeof(Slot) * n, alignof(Slot));
+                    std::memset(buf_.data() + data, 0, sizeof(Slot) * n);
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        const auto row = writeView(leaf, dense + elementSize * stride * i, dims, rank, dim + 1);
+                        const auto slot = at<Slot>(data + sizeof(Slot) * i);
+                        slot->type = static_cast<uint32_t>(ValueType::Array);
+                        slot->offset = row;
+                    }
+                }
+
+                const auto h = at<ArrayHeader>(offset);
+                h->elementType = static_cast<uint32_t>(dim + 1 < rank ? ValueType::Array : leaf);
+                h->rank = static_cast<uint32_t>(rank - dim);
+                h->count = n;
+                h->data = data;
+                h->dense = dense;
+                h->shape = dims + sizeof(uint64_t) * dim;
+                h->strides = dims + sizeof(uint64_t) * (rank + dim);
+                return offset;
+            }
+
+            static bool leafIsInteger(const array_t& arr)
+            {
+                const array_t* a = &arr;
+                while (a->elementType() == ValueType::Array)
+                {
+                    a = &a->valueAs<array_t>(0);
+                }
+                return a->elementType() == ValueType::Integer;
+            }
+        };
+    }
+
+    /// Immutable document laid out in one contiguous block.
+    /// Copies share the block. Handles returned by root() refer the block, they are valid while it is alive.
+    class FrozenDocument
+    {
+    private:
+        std::shared_ptr<const unsigned char> data_;
+        size_t size_ = 0;
+
+    public:
+        FrozenDocument() = default;
+
+        /// Adopt a block. 'data' needs to be aligned to frozen::Align bytes and to outlive this document.
+        FrozenDocument(std::shared_ptr<const unsigned char> data, size_t size)
+            : data_(std::move(data))
+            , size_(size)
+        {
+            const auto header = frozen::at<frozen::Header>(data_.get(), 0);
+            if (size_ < sizeof(frozen::Header) || (header->magic != frozen::Magic && header->magic != frozen::MagicSwapped))
+            {
+                throw ParseException("Not a frozen document.");
+            }
+            frozen::checkLayout(header->layout);
+            if (header->size > size_)
+            {
+                throw ParseException("Frozen document is truncated.");
+            }
+            if (header->size < sizeof(frozen::Header) || !frozen::Checker(data_.get(), header->size).run(header->root))
+            {
+                throw ParseException("Frozen document is broken.");
+            }
+        }
+
+        /// Return the root table.
+        FrozenTable root() const
+        {
+            const auto base = data_.get();
+            return FrozenTable(base, frozen::at<frozen::TableHeader>(base, frozen::at<frozen::Header>(base, 0)->root));
+        }
+
+        /// Whether the checksum of the block matches, reading the whole block.
+        bool verify() const
+        {
+            const auto header = frozen::at<frozen::Header>(data_.get(), 0);
+            return header->checksum == hashBytes(data_.get() + sizeof(frozen::Header), header->size - sizeof(frozen::Header));
+        }
+
+        /// Return the beginning of the block.
+        const unsigned char* data() const
+        {
+            return data_.get();
+        }
+
+        /// Return the bytes of the block.
+        size_t size() const
+        {
+            return size_;
+        }
+
+        explicit operator bool() const
+        {
+            return !!data_;
+        }
+    };
+
+    /// Copy the bytes into a new block aligned to frozen::Align.
+    inline std::shared_ptr<const unsigned char> allocateFrozen(const unsigned char* bytes, size_t size)
+    {
+        const auto p = static_cast<unsigned char*>(::operator new(size, std::align_val_t(frozen::Align)));
+        std::memcpy(p, bytes, size);
+        return std::shared_ptr<const unsigned char>(p, [](const unsigned char* q) {
+            ::operator delete(const_cast<unsigned char*>(q), std::align_val_t(frozen::Align));
+        });
+    }
+
+    /// Refer a block which lives as long as the program, such as one embedded by sml_embed().
+    /// Nothing is copied or freed. 'data' needs to be aligned to frozen::Align bytes.
+    inline FrozenDocument staticFrozen(const unsigned char* data, size_t size)
+    {
+        return FrozenDocument(std::shared_ptr<const unsigned char>(data, [](const unsigned char*) {}), size);
+    }
+
+    /// Options of freeze()
+    struct FreezeOptions
+    {
+        /// Build a minimal perfect hash for each table having at least 'perfectHashMinKeys' keys.
+        /// Lookups in such a table take one probe and one key comparison,
+        /// iterating it visits keys in hash order instead of key order.
+        bool perfectHash = false;
+        size_t perfectHashMinKeys = 8;
+    };
+
+    /// Relocate the whole table into one contiguous read only block.
+    /// Tables become arrays of entries sorted by key, arrays keep their elements contiguous.
+    inline FrozenDocument freeze(const table_t& table, const FreezeOptions& options = FreezeOptions())
+    {
+        const auto minKeys = options.perfectHash ? std::max<size_t>(options.perfectHashMinKeys, 1) : 0;
+        const auto bytes = frozen::Writer(minKeys).write(table);
+        return FrozenDocument(allocateFrozen(bytes.data(), bytes.size()), bytes.size());
+    }
+
+    /// ditto
+    inline FrozenDocument freeze(const std::shared_ptr<const table_t>& table, const FreezeOptions& options = FreezeOptions())
+    {
+        return freeze(*table, options);
+    }
+
+    /// From the key inside the table, return a mapped value as a 'T' type.
+    template <class T>
+    decltype(auto) valueAs(std::string_view key, const FrozenTable& t)
+    {
+        return t.template valueAs<T>(key);
+    }
+
+    /// Return true if the type of a value mapped by the key inside the table is 'T'.
+    template <class T>
+    bool valueIs(std::string_view key, const FrozenTable& t)
+    {
+        return t.template valueIs<T>(key);
+    }
+
+    /// Return the indexed value as a 'T' type.
+    template <class T>
+    decltype(auto) valueAs(size_t i, const FrozenArray& a)
+    {
+        return a.template valueAs<T>(i);
+    }
+
+    /// Return true if the array type is 'T'.
+    template <class T>
+    bool arrayIs(const FrozenArray& a)
+    {
+        return a.template arrayIs<T>();
+    }
+}
+
+#endif
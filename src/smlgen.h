@@ -0,0 +1,336 @@
+#ifndef SML_SMLGEN_H
+#define SML_SMLGEN_H
+
+#include "smldef.h"
+#include "smlobj.h"
+#include "smlparse.h"
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace sml
+{
+    /// Support of parsers generated by smlgen.
+    ///
+    /// A schema generated by smlgen is a struct with the members
+    ///   using Root = <root struct>;
+    ///   static bool open(Root&, std::string_view path, bool array, Cursor&);
+    ///   static bool set(Cursor&, std::string_view key, Reader&);
+    ///   static bool complete(const Root&);
+    ///   static void bind(const table_t&, Root&);
+    /// open() and set() return false when the text does not match the schema,
+    /// then the text is parsed generically and bound by bind().
+    namespace gen
+    {
+        /// Table which following keys go into.
+        struct Cursor
+        {
+            int kind = 0;
+            void* table = nullptr;
+            size_t hint = 0; // Index of the key expected next
+        };
+
+        /// Reader of the right value of a line into a field.
+        /// Each read returns false if the value is not of the type of the field.
+        class Reader : detail::Lexer
+        {
+        private:
+            using It = const char*;
+
+            Parser& parser_;
+            It it_;
+            It end_;
+
+        public:
+            Reader(Parser& parser, It it, It end)
+                : parser_(parser)
+                , it_(it)
+                , end_(end)
+            {
+            }
+
+            /// Return the rest of the line.
+            It position() const
+            {
+                return it_;
+            }
+
+            bool read(integer_t& v)
+            {
+                if (it_ == end_ || !isInteger(it_, end_))
+                {
+                    return false;
+                }
+                v = read_integer(it_, end_);
+                return true;
+            }
+
+            bool read(real_t& v)
+            {
+                if (it_ == end_ || !isReal(it_, end_))
+                {
+                    return false;
+                }
+                v = parser_.read_real(it_, end_);
+                return true;
+            }
+
+            bool read(std::string& v)
+            {
+                if (it_ == end_ || !isString(it_, end_))
+                {
+                    return false;
+                }
+                v = parser_.read_string(it_, end_);
+                return true;
+            }
+
+            template <class T>
+            bool read(std::vector<T>& v)
+            {
+                if (it_ == end_ || !isArray(it_, end_))
+                {
+                    return false;
+                }
+
+                // Empty arrays are not valid, as for the generic parser
+                v.clear();
+                while (*it_ != ']')
+                {
+                    ++it_; // Skip '[' or ','
+                    consumeWhitespace(it_, end_);
+                    v.emplace_back();
+                    if (!read(v.back()))
+                    {
+                        return false;
+                    }
+                    consumeWhitespace(it_, end_);
+                    if (it_ == end_ || (*it_ != ',' && *it_ != ']'))
+                    {
+                        return false;
+                    }
+                }
+                ++it_; // Skip ']'
+                return true;
+            }
+
+            /// Read a value of no fixed type by the generic parser.
+            bool read(std::shared_ptr<const Value>& v)
+            {
+                v = parser_.parse_value(it_, end_);
+                return true;
+            }
+        };
+
+        /// Return the index of the key, trying the hint first.
+        /// Return N if not found or already set.
+        template <size_t N>
+        size_t slotOf(const std::string_view (&keys)[N], std::string_view key, const std::bitset<N>& present, size_t hint)
+        {
+            size_t i = hint < N && keys[hint] == key ? hint : 0;
+            if (keys[i] != key)
+            {
+                for (i = 0; i < N && keys[i] != key; ++i)
+                {
+                }
+            }
+            return i < N && !present.test(i) ? i : N;
+        }
+
+        /// Throw KeyNotFound naming the first required key not present.
+        template <size_t N>
+        void require(const std::bitset<N>& present, const std::bitset<N>& required, const std::string_view (&keys)[N])
+        {
+            for (size_t i = 0; i < N; ++i)
+            {
+                if (required.test(i) && !present.test(i))
+                {
+                    throw KeyNotFound("key not found (" + std::string(keys[i]) + ")");
+                }
+            }
+        }
+
+        /// Parse the text straight into the root by the schema.
+        /// Return false if the text does not match the schema, leaving the root partially filled.
+        template <class Schema>
+        bool parseText(std::string_view text, typename Schema::Root& root)
+        {
+            using It = const char*;
+            using L = detail::Lexer;
+
+            Parser parser;
+            Cursor cursor{ 0, &root, 0 };
+            std::string path;
+
+            size_t pos = 0;
+            while (pos <= text.size())
+            {
+                auto eol = text.find('\n', pos);
+                eol = eol == std::string_view::npos ? text.size() : eol;
+                auto line = text.substr(pos, eol - pos);
+                pos = eol + 1;
+                if (!line.empty() && line.back() == '\r')
+                {
+                    line.remove_suffix(1);
+                }
+
+                It it = line.data();
+                const It end = it + line.size();
+                L::consumeWhitespace(it, end);
+                if (it == end || *it == '#')
+                {
+                    continue;
+                }
+
+                if (*it == '[' || *it == '+')
+                {
+                    // (+)[<key>.<key>...]
+                    const auto array = *it == '+';
+                    if (array)
+                    {
+                        ++it;
+                    }
+                    if (it == end || *it != '[')
+                    {
+                        return false;
+                    }
+
+                    path.clear();
+                    while (*it != ']')
+                    {
+                        if (*it == '.')
+                        {
+                            path += '.';
+                        }
+                        ++it; // Skip '[' or '.'
+                        L::consumeWhitespace(it, end);
+                        const It b = it;
+                        L::forward(it, end, [](char c) { return c != ' ' && c != '\t' && c != '.' && c != ']'; });
+                        if (it == b)
+                        {
+                            return false;
+                        }
+                        path.append(b, it);
+                        L::forward(it, end, [](char c) { return c != '.' && c != ']'; });
+                        if (it == end)
+                        {
+                            return false;
+                        }
+                    }
+                    ++it; // Skip ']'
+
+                    if (!Schema::open(root, path, array, cursor))
+                    {
+                        return false;
+                    }
+                }
+                else
+                {
+                    // <key> = <value>
+                    const It b = it;
+                    L::forward(it, end, [](char c) { return c != ' ' && c != '\t' && c != '='; });
+                    const auto key = std::string_view(b, static_cast<size_t>(it - b));
+                    L::forward(it, end, [](char c) { return c != '='; });
+                    if (it == end)
+                    {
+                        return false;
+                    }
+                    ++it; // Skip '='
+                    L::consumeWhitespace(it, end);
+
+                    Reader reader(parser, it, end);
+                    if (!Schema::set(cursor, key, reader))
+                    {
+                        return false;
+                    }
+                    it = reader.position();
+                }
+
+                L::consumeWhitespace(it, end);
+                if (it != end && *it != '#')
+                {
+                    return false;
+                }
+            }
+
+            return Schema::complete(root);
+        }
+
+        /// Parse the text into a new root by the schema.
+        /// If the text does not match the schema, parse it generically and bind the result.
+        /// Throw ParseException if the text is not valid, KeyNotFound if a required key is missing,
+        /// MismatchType if a value is not of the type of the field.
+        template <class Schema>
+        typename Schema::Root loadText(std::string_view text)
+        {
+            typename Schema::Root root;
+            if (!parseText<Schema>(text, root))
+            {
+                root = typename Schema::Root();
+                Schema::bind(*Parser().parseText(text), root);
+            }
+            return root;
+        }
+
+        /// Parse the .sml file into a new root by the schema.
+        template <class Schema>
+        typename Schema::Root load(const std::string& path)
+        {
+            std::ifstream in(path, std::ios::binary);
+            if (!in.is_open())
+            {
+                throw ParseException("Failed to open file (" + path + ")");
+            }
+            std::ostringstream text;
+            text << in.rdbuf();
+            return loadText<Schema>(text.str());
+        }
+
+        /// Bind the value to the field of the generic binding.
+        inline void bindValue(const Value& val, integer_t& out)
+        {
+            out = sml::valueAs<integer_t>(val);
+        }
+
+        /// ditto
+        inline void bindValue(const Value& val, real_t& out)
+        {
+            out = sml::valueAs<real_t>(val);
+        }
+
+        /// ditto
+        inline void bindValue(const Value& val, std::string& out)
+        {
+            out = sml::valueAs<string_t>(val);
+        }
+
+        /// ditto
+        template <class T>
+        void bindValue(const Value& val, std::vector<T>& out)
+        {
+            const auto& arr = sml::valueAs<array_t>(val);
+            out.clear();
+            out.resize(arr.length());
+            for (size_t i = 0; i < arr.length(); ++i)
+            {
+                if constexpr (IsVector<T>::value)
+                {
+                    bindValue(arr.valueAs<array_t>(i), out[i]);
+                }
+                else
+                {
+                    out[i] = arr.valueAs<T>(i);
+                }
+            }
+        }
+    }
+}
+
+#endif
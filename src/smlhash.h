@@ -0,0 +1,95 @@
+#ifndef SML_SMLHASH_H
+#define SML_SMLHASH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace sml
+{
+    /// Finalizer of MurmurHash3, scatters all bits of the input.
+    inline uint64_t hashMix(uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    /// Combine a hash value into another, order dependently.
+    inline uint64_t hashCombine(uint64_t h, uint64_t v)
+    {
+        return hashMix(h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)));
+    }
+
+    /// 64-bit hash of bytes, reading 8 bytes per step.
+    /// Not cryptographic. The result depends on the byte order of the machine.
+    inline uint64_t hashBytes(const void* data, size_t n, uint64_t seed = 0)
+    {
+        const auto p = static_cast<const unsigned char*>(data);
+        uint64_t h = seed ^ (n * 0x9e3779b97f4a7c15ULL);
+
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            uint64_t k;
+            std::memcpy(&k, p + i, 8);
+            h = (h ^ hashMix(k)) * 0x9e3779b97f4a7c15ULL;
+            h = (h << 31) | (h >> 33);
+        }
+
+        if (i < n)
+        {
+            uint64_t k = 0;
+            std::memcpy(&k, p + i, n - i);
+            h = (h ^ hashMix(k)) * 0x9e3779b97f4a7c15ULL;
+        }
+
+        return hashMix(h);
+    }
+
+    /// Lazily computed hash which concurrent readers may compute at once.
+    /// Zero means not computed yet. Copies do not carry the value.
+    class HashCache
+    {
+    private:
+        mutable std::atomic<uint64_t> value_{ 0 };
+
+    public:
+        HashCache() = default;
+
+        HashCache(const HashCache&)
+        {
+        }
+
+        HashCache& operator=(const HashCache&)
+        {
+            reset();
+            return *this;
+        }
+
+        /// Return the cached hash, computing it by 'f' at first.
+        template <class F>
+        uint64_t get(F f) const
+        {
+            auto h = value_.load(std::memory_order_relaxed);
+            if (h == 0)
+            {
+                h = f();
+                h = h == 0 ? 1 : h;
+                value_.store(h, std::memory_order_relaxed);
+            }
+            return h;
+        }
+
+        void reset()
+        {
+            value_.store(0, std::memory_order_relaxed);
+        }
+    };
+}
+
+#endif
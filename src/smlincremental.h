@@ -0,0 +1,249 @@
+#ifndef SML_SMLINCREMENTAL_H
+#define SML_SMLINCREMENTAL_H
+
+#include "smldedup.h"
+#include "smldef.h"
+#include "smlhash.h"
+#include "smlkey.h"
+#include "smlobj.h"
+#include "smlparse.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sml
+{
+    /// Parser which keeps the previous document and reparses only what changed.
+    /// Lines are grouped by the first key of the table header they follow, and each group
+    /// is hashed. A group with the same hash as before reuses its previous subtree.
+    /// Lines before the first header form the root group.
+    class IncrementalParser
+    {
+    private:
+        struct Group
+        {
+            uint64_t hash = 0;
+            std::vector<std::string_view> lines;
+        };
+
+        struct Entry
+        {
+            uint64_t hash;
+            std::shared_ptr<Value> value;
+        };
+
+        ParseOptions options_;
+
+        bool parsedOnce_ = false;
+        uint64_t rootHash_ = 0;
+        std::vector<std::pair<std::string, std::shared_ptr<Value>>> rootEntries_;
+        std::unordered_map<std::string, Entry> groups_;
+
+        size_t reused_ = 0;
+        size_t parsed_ = 0;
+
+    public:
+        /// A pool is made if no pool is given, so keys are shared across parses.
+        /// If dedup is enabled, each reparsed group is deduplicated alone.
+        explicit IncrementalParser(const ParseOptions& options = ParseOptions())
+            : options_(options)
+        {
+            if (!options_.keys)
+            {
+                options_.keys = std::make_shared<KeyPool>();
+            }
+        }
+
+        /// Parse a .sml file, reusing unchanged groups of the previous parse.
+        std::shared_ptr<const table_t> parse(const std::string& path)
+        {
+            std::ifstream in(path, std::ios::binary);
+            if (!in.is_open())
+            {
+                throw ParseException("Failed to open file (" + path + ")");
+            }
+
+            std::ostringstream text;
+            text << in.rdbuf();
+            return parseText(text.str());
+        }
+
+        /// Parse the text, reusing unchanged groups of the previous parse.
+        /// If failed, the previous state is kept.
+        std::shared_ptr<const table_t> parseText(std::string_view text)
+        {
+            Group root;
+            std::vector<std::string> order;
+            std::unordered_map<std::string, Group> groups;
+            split(text, root, order, groups);
+
+            Parser parser(parserOptions());
+            size_t reused = 0;
+            size_t parsed = 0;
+
+            // Root group
+            auto rootEntries = rootEntries_;
+            if (!parsedOnce_ || root.hash != rootHash_)
+            {
+                const auto table = parseGroup(parser, root);
+                rootEntries.clear();
+                for (const auto e : *table)
+                {
+                    rootEntries.emplace_back(e.first, std::const_pointer_cast<Value>(table->node(e.first)));
+                }
+                ++parsed;
+            }
+            else
+            {
+                ++reused;
+            }
+
+            const auto doc = std::make_shared<table_t>();
+            for (const auto& e : rootEntries)
+            {
+                doc->addValue(parser.intern(std::cbegin(e.first), std::cend(e.first)), e.second);
+            }
+
+            // Groups of headers
+            std::unordered_map<std::string, Entry> entries;
+            for (const auto& key : order)
+            {
+                const auto& group = groups[key];
+                if (doc->contains(key))
+                {
+                    throw ParseException("Key duplicated (" + key + ")");
+                }
+
+                const auto prev = groups_.find(key);
+                std::shared_ptr<Value> value;
+                if (prev != std::cend(groups_) && prev->second.hash == group.hash)
+                {
+                    value = prev->second.value;
+                    ++reused;
+                }
+                else
+                {
+                    const auto table = parseGroup(parser, group);
+                    value = std::const_pointer_cast<Value>(table->node(key));
+                    if (!value || table->length() != 1)
+                    {
+                        throw ParseException("Key is not defined (" + key + ").");
+                    }
+                    ++parsed;
+                }
+
+                doc->addValue(parser.intern(std::cbegin(key), std::cend(key)), value);
+                entries.emplace(key, Entry{ group.hash, value });
+            }
+
+            parsedOnce_ = true;
+            rootHash_ = root.hash;
+            rootEntries_ = std::move(rootEntries);
+            groups_ = std::move(entries);
+            reused_ = reused;
+            parsed_ = parsed;
+            return doc;
+        }
+
+        /// Count of groups reused by the last parse.
+        size_t reused() const
+        {
+            return reused_;
+        }
+
+        /// Count of groups parsed by the last parse.
+        size_t parsed() const
+        {
+            return parsed_;
+        }
+
+    private:
+        ParseOptions parserOptions() const
+        {
+            auto options = options_;
+            options.dedup = false;
+            return options;
+        }
+
+        /// Split the text into lines and group them by the first key of headers.
+        static void split(std::string_view text, Group& root, std::vector<std::string>& order,
+                          std::unordered_map<std::string, Group>& groups)
+        {
+            Group* current = &root;
+            size_t pos = 0;
+            while (pos < text.size())
+            {
+                auto eol = text.find('\n', pos);
+                eol = eol == std::string_view::npos ? text.size() : eol;
+                auto line = text.substr(pos, eol - pos);
+                pos = eol + 1;
+                if (!line.empty() && line.back() == '\r')
+                {
+                    line.remove_suffix(1);
+                }
+
+                auto first = line.find_first_not_of(" \t");
+                if (first != std::string_view::npos && (line[first] == '[' || line[first] == '+'))
+                {
+                    const auto key = std::string(headKey(line.substr(first)));
+                    const auto found = groups.find(key);
+                    if (found == std::cend(groups))
+                    {
+                        order.emplace_back(key);
+                        current = &groups[key];
+                    }
+                    else
+                    {
+                        current = &found->second;
+                    }
+                }
+
+                current->lines.emplace_back(line);
+                current->hash = hashCombine(current->hash, hashBytes(line.data(), line.size()));
+            }
+        }
+
+        /// Return the first key of the header "(+)[<key>.<key>...]".
+        static std::string_view headKey(std::string_view header)
+        {
+            size_t b = 0;
+            if (b < header.size() && header[b] == '+')
+            {
+                ++b;
+            }
+            if (b < header.size() && header[b] == '[')
+            {
+                ++b;
+            }
+            b = (std::min)(header.find_first_not_of(" \t", b), header.size());
+            const auto e = (std::min)(header.find_first_of(" \t.]", b), header.size());
+            return header.substr(b, e - b);
+        }
+
+        std::shared_ptr<table_t> parseGroup(Parser& parser, const Group& group) const
+        {
+            const auto table = std::make_shared<table_t>();
+            table_t* current = table.get();
+            for (const auto& line : group.lines)
+            {
+                parser.parse_line(line.data(), line.data() + line.size(), table.get(), current);
+            }
+            if (options_.dedup)
+            {
+                dedup(*table);
+            }
+            return table;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef SML_SMLKEY_H
+#define SML_SMLKEY_H
+
+#include "smlhash.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace sml
+{
+    /// Immutable table key with its precomputed hash.
+    /// Keys interned by the same pool share one string, so they compare by the pointer.
+    class Key
+    {
+    private:
+        struct Data
+        {
+            uint64_t hash;
+            std::string str;
+        };
+
+        std::shared_ptr<const Data> data_;
+
+        explicit Key(std::shared_ptr<const Data> data)
+            : data_(std::move(data))
+        {
+        }
+
+        friend class KeyPool;
+
+    public:
+        /// Make a key which is not interned.
+        explicit Key(std::string_view str = std::string_view())
+            : data_(std::make_shared<const Data>(Data{ hashBytes(str.data(), str.size()), std::string(str) }))
+        {
+        }
+
+        const std::string& str() const
+        {
+            return data_->str;
+        }
+
+        uint64_t hash() const
+        {
+            return data_->hash;
+        }
+
+        /// Whether both keys refer the same interned string.
+        bool same(const Key& rhs) const
+        {
+            return data_ == rhs.data_;
+        }
+
+        bool operator==(const Key& rhs) const
+        {
+            return same(rhs) || (hash() == rhs.hash() && str() == rhs.str());
+        }
+
+        bool operator!=(const Key& rhs) const
+        {
+            return !(*this == rhs);
+        }
+    };
+
+    /// Pool of interned keys.
+    /// Share one pool across parses to share keys across documents.
+    /// Interning is thread safe. Keys outlive the pool.
+    class KeyPool
+    {
+    private:
+        mutable std::mutex mutex_;
+        std::unordered_map<std::string_view, Key> keys_;
+
+    public:
+        KeyPool() = default;
+
+        KeyPool(const KeyPool&) = delete;
+        KeyPool& operator=(const KeyPool&) = delete;
+
+        /// Return the key equal to the string, adding it if not exists.
+        Key intern(std::string_view str)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            const auto found = keys_.find(str);
+            if (found != std::cend(keys_))
+            {
+                return found->second;
+            }
+
+            const Key key(str);
+            keys_.emplace(key.str(), key);
+            return key;
+        }
+
+        /// Count of interned keys.
+        size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return keys_.size();
+        }
+
+        /// Remove keys no longer used by any document.
+        /// Return the count of removed keys.
+        size_t collect()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            size_t removed = 0;
+            for (auto it = std::begin(keys_); it != std::end(keys_);)
+            {
+                if (it->second.data_.use_count() == 1)
+                {
+                    it = keys_.erase(it);
+                    ++removed;
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            return removed;
+        }
+    };
+}
+
+#endif
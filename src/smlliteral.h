@@ -0,0 +1,609 @@
+#ifndef SML_SMLLITERAL_H
+#define SML_SMLLITERAL_H
+
+#include "smldef.h"
+#include "smlparse.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+namespace sml
+{
+    /// Value of a literal document.
+    /// Children of a table or an array are linked from 'first' through 'next'.
+    /// Integers and reals are kept as their characters, converted when read.
+    struct LiteralNode
+    {
+        static constexpr uint32_t npos = static_cast<uint32_t>(-1);
+
+        ValueType type = ValueType::Null;
+        ValueType elementType = ValueType::Null; // Of an array
+        uint32_t count = 0;
+        uint32_t first = npos;
+        uint32_t next = npos;
+        std::string_view key;  // Empty for an element of an array
+        std::string_view text; // Characters of an integer, a real or a string without quotes
+    };
+
+    class LiteralTable;
+    class LiteralArray;
+
+    /// Type of values read from a literal document as a 'T' type
+    template <class T>
+    struct LiteralType
+    {
+        using type = T;
+    };
+
+    template <>
+    struct LiteralType<string_t>
+    {
+        using type = std::string_view;
+    };
+
+    template <>
+    struct LiteralType<array_t>
+    {
+        using type = LiteralArray;
+    };
+
+    template <>
+    struct LiteralType<table_t>
+    {
+        using type = LiteralTable;
+    };
+
+    template <class T>
+    using LiteralType_t = typename LiteralType<T>::type;
+
+    namespace detail
+    {
+        template <class T>
+        constexpr LiteralType_t<T> readLiteral(const LiteralNode* nodes, size_t i);
+
+        template <size_t Capacity>
+        class LiteralParser;
+    }
+
+    /// Read only handle of an array inside a literal document, with the read API of array_t.
+    class LiteralArray
+    {
+    private:
+        const LiteralNode* nodes_ = nullptr;
+        size_t index_ = 0;
+
+    public:
+        constexpr LiteralArray(const LiteralNode* nodes, size_t index)
+            : nodes_(nodes)
+            , index_(index)
+        {
+        }
+
+        /// Return the size of this array
+        constexpr size_t length() const
+        {
+            return nodes_[index_].count;
+        }
+
+        /// Return the type tag of elements, or ValueType::Null if this array is empty.
+        constexpr ValueType elementType() const
+        {
+            return nodes_[index_].elementType;
+        }
+
+        /// Return true if the array type is 'T'.
+        template <class T>
+        constexpr bool arrayIs() const
+        {
+            return elementType() == ValueTypeOf<T>::value;
+        }
+
+        /// Return the indexed value as a 'T' type.
+        template <class T>
+        constexpr LiteralType_t<T> valueAs(size_t i) const
+        {
+            if (i >= length())
+            {
+                throw std::out_of_range("Index out of range.");
+            }
+            if (!arrayIs<T>())
+            {
+                throw MismatchType();
+            }
+
+            auto n = nodes_[index_].first;
+            for (; i > 0; --i)
+            {
+                n = nodes_[n].next;
+            }
+            return detail::readLiteral<T>(nodes_, n);
+        }
+    };
+
+    /// Read only handle of a table inside a literal document, with the read API of table_t.
+    /// Strings are read as std::string_view, arrays and tables as handles.
+    class LiteralTable
+    {
+    private:
+        const LiteralNode* nodes_ = nullptr;
+        size_t index_ = 0;
+
+    public:
+        constexpr LiteralTable(const LiteralNode* nodes, size_t index)
+            : nodes_(nodes)
+            , index_(index)
+        {
+        }
+
+        /// Whether this table contains the key.
+        constexpr bool contains(std::string_view key) const
+        {
+            return find(key) != LiteralNode::npos;
+        }
+
+        /// Count of keys.
+        constexpr size_t length() const
+        {
+            return nodes_[index_].count;
+        }
+
+        /// From the key inside the table, return a mapped value as a 'T' type.
+        template <class T>
+        constexpr LiteralType_t<T> valueAs(std::string_view key) const
+        {
+            const auto n = find(key);
+            if (n == LiteralNode::npos)
+            {
+                throw KeyNotFound();
+            }
+            if (nodes_[n].type != ValueTypeOf<T>::value)
+            {
+                throw MismatchType();
+            }
+            return detail::readLiteral<T>(nodes_, n);
+        }
+
+        /// Return true if the type of a value mapped by the key inside the table is 'T'.
+        /// The case of type mismatch or the key is not exists, return false.
+        template <class T>
+        constexpr bool valueIs(std::string_view key) const
+        {
+            const auto n = find(key);
+            return n != LiteralNode::npos && nodes_[n].type == ValueTypeOf<T>::value;
+        }
+
+    private:
+        constexpr uint32_t find(std::string_view key) const
+        {
+            for (auto n = nodes_[index_].first; n != LiteralNode::npos; n = nodes_[n].next)
+            {
+                if (nodes_[n].key == key)
+                {
+                    return n;
+                }
+            }
+            return LiteralNode::npos;
+        }
+    };
+
+    namespace detail
+    {
+        /// Digits are accumulated as an integer and scaled once, so results may differ
+        /// from the runtime parser in the last bit.
+        constexpr real_t readLiteralReal(std::string_view text)
+        {
+            auto it = text.begin();
+            const auto end = text.end();
+            const auto negative = *it == '-';
+            if (*it == '+' || *it == '-')
+            {
+                ++it; // Skip '+' or '-'
+            }
+
+            long double mantissa = 0;
+            long double scale = 1;
+            for (; it != end && '0' <= *it && *it <= '9'; ++it)
+            {
+                mantissa = mantissa * 10 + (*it - '0');
+            }
+            ++it; // Skip '.'
+            for (; it != end && '0' <= *it && *it <= '9'; ++it)
+            {
+                mantissa = mantissa * 10 + (*it - '0');
+                scale *= 10;
+            }
+
+            const auto r = static_cast<real_t>(mantissa / scale);
+            return negative ? -r : r;
+        }
+
+        template <class T>
+        constexpr LiteralType_t<T> readLiteral(const LiteralNode* nodes, size_t i)
+        {
+            if constexpr (std::is_same<T, integer_t>::value)
+            {
+                auto it = nodes[i].text.begin();
+                return Lexer::read_integer(it, nodes[i].text.end());
+            }
+            else if constexpr (std::is_same<T, real_t>::value)
+            {
+                return readLiteralReal(nodes[i].text);
+            }
+            else if constexpr (std::is_same<T, string_t>::value)
+            {
+                return nodes[i].text;
+            }
+            else
+            {
+                return LiteralType_t<T>(nodes, i);
+            }
+        }
+    }
+
+    /// Document parsed at compile time, holding up to 'Capacity' values.
+    /// Strings refer the characters of the literal text.
+    template <size_t Capacity>
+    class LiteralDocument
+    {
+        static_assert(Capacity < LiteralNode::npos, "Too many values.");
+
+    private:
+        template <size_t>
+        friend class detail::LiteralParser;
+
+        std::array<LiteralNode, Capacity> nodes_{};
+        size_t size_ = 1; // The root table
+
+    public:
+        constexpr LiteralDocument()
+        {
+            nodes_[0].type = ValueType::Table;
+        }
+
+        /// Return the root table.
+        constexpr LiteralTable root() const
+        {
+            return LiteralTable(nodes_.data(), 0);
+        }
+
+        /// Count of values including the root table.
+        constexpr size_t size() const
+        {
+            return size_;
+        }
+
+        /// Count of values this document can hold.
+        static constexpr size_t capacity()
+        {
+            return Capacity;
+        }
+
+        constexpr const LiteralNode& operator[](size_t i) const
+        {
+            return nodes_[i];
+        }
+    };
+
+    namespace detail
+    {
+        /// Parser of the .sml format into a LiteralDocument, by the scanning of Parser.
+        template <size_t Capacity>
+        class LiteralParser : Lexer
+        {
+        private:
+            using It = const char*;
+
+            LiteralDocument<Capacity>& doc_;
+            std::array<uint32_t, Capacity> last_{}; // Last child of each table and array
+
+        public:
+            constexpr explicit LiteralParser(LiteralDocument<Capacity>& doc)
+                : doc_(doc)
+            {
+            }
+
+            constexpr void parse(std::string_view text)
+            {
+                uint32_t current = 0;
+                size_t pos = 0;
+                while (pos <= text.size())
+                {
+                    auto eol = text.find('\n', pos);
+                    eol = eol == std::string_view::npos ? text.size() : eol;
+                    auto line = text.substr(pos, eol - pos);
+                    if (!line.empty() && line.back() == '\r')
+                    {
+                        line.remove_suffix(1);
+                    }
+                    parse_line(line.data(), line.data() + line.size(), current);
+                    pos = eol + 1;
+                }
+            }
+
+        private:
+            /// Add a value to the table or the array. Return its index.
+            constexpr uint32_t add(uint32_t parent, std::string_view key, ValueType type)
+            {
+                if (doc_.size_ == Capacity)
+                {
+                    throw ParseException("Too many values.");
+                }
+
+                auto& p = doc_.nodes_[parent];
+                if (p.type == ValueType::Array)
+                {
+                    if (p.count == 0)
+                    {
+                        p.elementType = type;
+                    }
+                    else if (p.elementType != type)
+                    {
+                        throw MismatchType();
+                    }
+                }
+
+                const auto i = static_cast<uint32_t>(doc_.size_++);
+                doc_.nodes_[i].type = type;
+                doc_.nodes_[i].key = key;
+                if (p.first == LiteralNode::npos)
+                {
+                    p.first = i;
+                }
+                else
+                {
+                    doc_.nodes_[last_[parent]].next = i;
+                }
+                last_[parent] = i;
+                ++p.count;
+                return i;
+            }
+
+            /// Return the child of the table by the key, or LiteralNode::npos if not found.
+            constexpr uint32_t child(uint32_t table, std::string_view key) const
+            {
+                for (auto n = doc_[table].first; n != LiteralNode::npos; n = doc_[n].next)
+                {
+                    if (doc_[n].key == key)
+                    {
+                        return n;
+                    }
+                }
+                return LiteralNode::npos;
+            }
+
+            constexpr void parse_line(It it, It end, uint32_t& current)
+            {
+                consumeWhitespace(it, end);
+                if (it == end || *it == '#')
+                {
+                    return;
+                }
+
+                if (*it == '[' || *it == '+')
+                {
+                    current = parse_table(it, end);
+                }
+                else
+                {
+                    parse_key_eq_value(it, end, current);
+                }
+
+                consumeWhitespace(it, end);
+                if (it != end && *it != '#')
+                {
+                    throw ParseException("Unexpected character.");
+                }
+            }
+
+            constexpr void parse_key_eq_value(It& it, It end, uint32_t table)
+            {
+                const It keyB = it;
+                forward(it, end, [](char c) { return c != ' ' && c != '\t' && c != '='; });
+                const It keyE = it;
+                forward(it, end, [](char c) { return c != '='; });
+                if (it == end)
+                {
+                    throw ParseException("Unexpected EOL.");
+                }
+
+                const auto key = std::string_view(keyB, static_cast<size_t>(keyE - keyB));
+                if (child(table, key) != LiteralNode::npos)
+                {
+                    throw ParseException("Key duplicated.");
+                }
+
+                ++it; // Skip '='.
+                consumeWhitespace(it, end);
+                parse_value(it, end, table, key);
+            }
+
+            constexpr void parse_value(It& it, It end, uint32_t parent, std::string_view key)
+            {
+                if (it == end)
+                {
+                    throw ParseException("Unexpected EOL.");
+                }
+
+                if (isInteger(it, end))
+                {
+                    const auto i = add(parent, key, ValueType::Integer);
+                    const It b = it;
+                    read_integer(it, end); // Fail on out of range here, not when read
+                    doc_.nodes_[i].text = std::string_view(b, static_cast<size_t>(it - b));
+                }
+                else if (isReal(it, end))
+                {
+                    const auto i = add(parent, key, ValueType::Real);
+                    const It b = it;
+                    if (*it == '+' || *it == '-')
+                    {
+                        ++it; // Skip '+' or '-'
+                    }
+                    forward(it, end, [](char c) { return '0' <= c && c <= '9'; });
+                    ++it; // Skip '.'
+                    forward(it, end, [](char c) { return '0' <= c && c <= '9'; });
+                    doc_.nodes_[i].text = std::string_view(b, static_cast<size_t>(it - b));
+                }
+                else if (isString(it, end))
+                {
+                    ++it; // Skip '\"'
+                    const It b = it;
+                    forward(it, end, [](char c) { return c != '\"'; });
+                    const auto i = add(parent, key, ValueType::String);
+                    doc_.nodes_[i].text = std::string_view(b, static_cast<size_t>(it - b));
+                    ++it; // Skip '\"'
+                }
+                else if (isArray(it, end))
+                {
+                    const auto arr = add(parent, key, ValueType::Array);
+                    while (*it != ']')
+                    {
+                        ++it; // Skip '[' or ','
+                        consumeWhitespace(it, end);
+                        parse_value(it, end, arr, std::string_view());
+                        consumeWhitespace(it, end);
+                    }
+                    ++it; // Skip ']'
+                }
+                else
+                {
+                    throw ParseException("Unexpected right value.");
+                }
+            }
+
+            // (+)[<key>.<key>...]
+            constexpr uint32_t parse_table(It& it, It end)
+            {
+                const auto isTableArray = *it == '+';
+                if (isTableArray)
+                {
+                    ++it;
+                }
+                if (it == end || *it != '[')
+                {
+                    throw ParseException("Unexpected character.");
+                }
+
+                uint32_t cur = 0;
+                while (*it != ']')
+                {
+                    ++it; // Skip '[' or '.'.
+                    consumeWhitespace(it, end);
+
+                    const It keyB = it;
+                    forward(it, end, [](char c) { return c != ' ' && c != '\t' && c != '.' && c != ']'; });
+                    const auto key = std::string_view(keyB, static_cast<size_t>(it - keyB));
+                    forward(it, end, [](char c) { return c != '.' && c != ']'; });
+                    if (it == end)
+                    {
+                        throw ParseException("Unexpected EOL.");
+                    }
+                    if (key.empty())
+                    {
+                        throw ParseException("Unexpected character.");
+                    }
+
+                    const auto found = child(cur, key);
+                    if (*it == '.')
+                    {
+                        // Intermediate key, the last element of a table array is followed
+                        if (found == LiteralNode::npos)
+                        {
+                            throw ParseException("Key is not defined.");
+                        }
+                        cur = found;
+                        if (doc_[cur].type == ValueType::Array && doc_[cur].elementType == ValueType::Table)
+                        {
+                            cur = last_[cur];
+                        }
+                        else if (doc_[cur].type != ValueType::Table)
+                        {
+                            throw ParseException("Key is not defined.");
+                        }
+                    }
+                    else if (isTableArray)
+                    {
+                        auto arr = found;
+                        if (arr == LiteralNode::npos)
+                        {
+                            arr = add(cur, key, ValueType::Array);
+                        }
+                        else if (doc_[arr].type != ValueType::Array || doc_[arr].elementType != ValueType::Table)
+                        {
+                            throw ParseException("Key is not defined.");
+                        }
+                        cur = add(arr, std::string_view(), ValueType::Table);
+                    }
+                    else
+                    {
+                        if (found != LiteralNode::npos)
+                        {
+                            throw ParseException("Key duplicated.");
+                        }
+                        cur = add(cur, key, ValueType::Table);
+                    }
+                }
+
+                ++it; // Skip ']'.
+                return cur;
+            }
+        };
+    }
+
+    /// Parse a .sml text at compile time, such as
+    ///   constexpr auto config = SML_LITERAL(R"(a = 1)");
+    /// Errors in the text fail the compilation. The document refers the text,
+    /// which has static storage as a string literal. If 'Capacity' is 0, it is bounded
+    /// by the length of the text; SML_LITERAL passes literalSize() of the text instead.
+    template <size_t Capacity = 0, size_t N>
+    constexpr LiteralDocument<(Capacity ? Capacity : N / 2 + 2)> parseLiteral(const char (&text)[N])
+    {
+        constexpr auto capacity = Capacity ? Capacity : N / 2 + 2;
+        LiteralDocument<capacity> doc;
+        detail::LiteralParser<capacity>(doc).parse(std::string_view(text, N - 1));
+        return doc;
+    }
+
+    /// Count of values in a .sml text including the root table, to size a LiteralDocument.
+    template <size_t N>
+    constexpr size_t literalSize(const char (&text)[N])
+    {
+        return parseLiteral(text).size();
+    }
+
+    /// From the key inside the table, return a mapped value as a 'T' type.
+    template <class T>
+    constexpr LiteralType_t<T> valueAs(std::string_view key, const LiteralTable& t)
+    {
+        return t.template valueAs<T>(key);
+    }
+
+    /// Return true if the type of a value mapped by the key inside the table is 'T'.
+    template <class T>
+    constexpr bool valueIs(std::string_view key, const LiteralTable& t)
+    {
+        return t.template valueIs<T>(key);
+    }
+
+    /// Return the indexed value as a 'T' type.
+    template <class T>
+    constexpr LiteralType_t<T> valueAs(size_t i, const LiteralArray& a)
+    {
+        return a.template valueAs<T>(i);
+    }
+
+    /// Return true if the array type is 'T'.
+    template <class T>
+    constexpr bool arrayIs(const LiteralArray& a)
+    {
+        return a.template arrayIs<T>();
+    }
+}
+
+/// Parse a .sml text at compile time into a document holding exactly its values.
+#define SML_LITERAL(text) ::sml::parseLiteral<::sml::literalSize(text)>(text)
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef SML_SMLMMAP_H
+#define SML_SMLMMAP_H
+
+// Mapping of files into memory. Not included by sml.h, as it includes the platform headers:
+// <windows.h> on Windows, which defines min and max unless NOMINMAX is defined before,
+// and the POSIX headers elsewhere.
+
+#include "smlbinary.h"
+#include "smldef.h"
+#include "smlfrozen.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SML_HAS_MMAP
+#endif
+
+namespace sml
+{
+    namespace detail
+    {
+        /// Map the file read only. Return nullptr if mapping is not available.
+        inline std::shared_ptr<const unsigned char> mapFile(const std::string& path, size_t& size)
+        {
+#if defined(_WIN32)
+            const auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                throw ParseException("Failed to open file (" + path + ")");
+            }
+
+            LARGE_INTEGER length;
+            if (!GetFileSizeEx(file, &length) || length.QuadPart < static_cast<LONGLONG>(sizeof(frozen::Header)))
+            {
+                CloseHandle(file);
+                throw ParseException("Not a frozen document (" + path + ")");
+            }
+            size = static_cast<size_t>(length.QuadPart);
+
+            const auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            CloseHandle(file);
+            if (!mapping)
+            {
+                return nullptr;
+            }
+            const auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if (!view)
+            {
+                return nullptr;
+            }
+            return std::shared_ptr<const unsigned char>(static_cast<const unsigned char*>(view), [](const unsigned char* p) {
+                UnmapViewOfFile(p);
+            });
+#elif defined(SML_HAS_MMAP)
+            const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                throw ParseException("Failed to open file (" + path + ")");
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(frozen::Header)))
+            {
+                close(fd);
+                throw ParseException("Not a frozen document (" + path + ")");
+            }
+            size = static_cast<size_t>(st.st_size);
+
+            const auto p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (p == MAP_FAILED)
+            {
+                return nullptr;
+            }
+            return std::shared_ptr<const unsigned char>(static_cast<const unsigned char*>(p), [size](const unsigned char* q) {
+                munmap(const_cast<unsigned char*>(q), size);
+            });
+#else
+            (void)path;
+            (void)size;
+            return nullptr;
+#endif
+        }
+    }
+
+    /// Load a .smlb file written by saveFrozen() by mapping it into memory,
+    /// so pages are read on first access and shared among processes mapping the same file.
+    /// Where mapping is not available the file is read whole as loadFrozen() does.
+    /// If 'verify' is true, the checksum is checked first, which reads the whole file.
+    /// Throw ParseException if the file is not a frozen document of this version.
+    inline FrozenDocument mapFrozen(const std::string& path, bool verify = true)
+    {
+        size_t size = 0;
+        auto data = detail::mapFile(path, size);
+        if (!data)
+        {
+            return loadFrozen(path, verify);
+        }
+
+        FrozenDocument doc(std::move(data), size);
+        if (verify && !doc.verify())
+        {
+            throw ParseException("Checksum mismatch (" + path + ")");
+        }
+        return doc;
+    }
+}
+
+#endif
@@ -1,421 +1,1872 @@
-#ifndef SML_SMLOBJ_H
-#define SML_SMLOBJ_H
-
-#include "smldef.h"
-#include <memory>
-#include <string>
-#include <vector>
-#include <unordered_map>
-
-namespace sml
-{
-    class Value
-    {
-    public:
-        virtual bool is(TypeTag<integer_t>) const { return false; }
-        virtual bool is(TypeTag<real_t>) const { return false; }
-        virtual bool is(TypeTag<string_t>) const { return false; }
-        virtual bool is(TypeTag<array_t>) const { return false; }
-        virtual bool is(TypeTag<table_t>) const { return false; }
-        virtual void accept(Visitor& v) const {}
-    };
-
-    /// Apply visitor for type safe processes.
-    inline void applyVisitor(Visitor& v, const Value& val)
-    {
-        val.accept(v);
-    }
-
-    /// ditto
-    inline void applyVisitor(Visitor&& v, const Value& val)
-    {
-        val.accept(v);
-    }
-
-    class Integer : public Value
-    {
-        integer_t i_;
-
-    public:
-        Integer(integer_t i)
-            : i_(i)
-        {
-        }
-
-        bool is(TypeTag<integer_t>) const
-        {
-            return true;
-        }
-
-        void accept(Visitor& v) const
-        {
-            v.visit(ref());
-        }
-
-        integer_t& ref()
-        {
-            return i_;
-        }
-
-        const integer_t& ref() const
-        {
-            return i_;
-        }
-    };
-
-    class Real : public Value
-    {
-    private:
-        real_t r_;
-
-    public:
-        Real(real_t r)
-            : r_(r)
-        {
-        }
-
-        bool is(TypeTag<real_t>) const
-        {
-            return true;
-        }
-
-        void accept(Visitor& v) const
-        {
-            v.visit(ref());
-        }
-
-        real_t& ref()
-        {
-            return r_;
-        }
-
-        const real_t& ref() const
-        {
-            return r_;
-        }
-    };
-
-    class String : public Value
-    {
-    private:
-        string_t s_;
-
-    public:
-        String(const std::string& s)
-            : s_(s)
-        {
-        }
-
-        bool is(TypeTag<string_t>) const
-        {
-            return true;
-        }
-
-        void accept(Visitor& v) const
-        {
-            v.visit(ref());
-        }
-
-        string_t& ref()
-        {
-            return s_;
-        }
-
-        const string_t& ref() const
-        {
-            return s_;
-        }
-    };
-
-    /// Array type
-    class array_t : public Value
-    {
-    private:
-        std::vector<std::shared_ptr<Value>> arr_;
-
-    public:
-        array_t() = default;
-        array_t(const array_t&) = default;
-        array_t(array_t&&) = default;
-
-        array_t& operator=(const array_t&) = default;
-        array_t& operator=(array_t&&) = default;
-
-        bool is(TypeTag<array_t>) const
-        {
-            return true;
-        }
-
-        void accept(Visitor& v) const
-        {
-            v.visit(ref());
-        }
-
-        void acceptAt(Visitor& v, size_t i) const
-        {
-            if (i < arr_.size())
-            {
-                arr_[i]->accept(v);
-            }
-            else
-            {
-                v.visit(Null());
-            }
-        }
-
-        array_t& ref()
-        {
-            return *this;
-        }
-
-        const array_t& ref() const
-        {
-            return *this;
-        }
-
-        /// Return the size of this array
-        size_t length() const
-        {
-            return arr_.size();
-        }
-
-        /// Return the indexed value as a 'T' type. 
-        template <class T>
-        const T& valueAs(size_t i) const
-        {
-            using Obj = ObjectType_t<T>;
-            if (!arrayIs<T>())
-            {
-                throw MismatchType();
-            }
-            const auto val = std::dynamic_pointer_cast<Obj>(arr_.at(i));
-            return val->ref();
-        }
-
-        template <class T>
-        T& valueAs(size_t i)
-        {
-            return const_cast<T&>(const_cast<const array_t&>(*this).template valueAs<T>(i));
-        }
-
-        /// Return true if the array type is 'T'.
-        template <class T>
-        bool arrayIs() const
-        {
-            return arr_.at(0)->is(TypeTag<T>());
-        }
-
-        void insertBack(const std::shared_ptr<Value>& val)
-        {
-            arr_.emplace_back(val);
-        }
-    };
-
-    /// Return the indexed value as a 'T' type. 
-    template <class T>
-    const T& valueAs(size_t i, const array_t& a)
-    {
-        return a.template valueAs<T>(i);
-    }
-
-    /// Return true if the array type is 'T'.
-    template <class T>
-    bool arrayIs(const array_t& a)
-    {
-        return a.template arrayIs<T>();
-    }
-
-    /// Apply visitor for type safe processes.
-    inline void applyVisitorAt(Visitor& v, size_t i, const array_t& val)
-    {
-        val.acceptAt(v, i);
-    }
-
-    /// ditto
-    inline void applyVisitorAt(Visitor&& v, size_t i, const array_t& val)
-    {
-        val.acceptAt(v, i);
-    }
-
-    /// Table type
-    class table_t : public Value
-    {
-    private:
-        std::unordered_map<std::string, std::shared_ptr<Value>> table_;
-
-    public:
-        table_t() = default;
-        table_t(const table_t&) = default;
-        table_t(table_t&&) = default;
-
-        table_t& operator=(const table_t&) = default;
-        table_t& operator=(table_t&&) = default;
-
-        bool is(TypeTag<table_t>) const
-        {
-            return true;
-        }
-
-        void accept(Visitor& v) const
-        {
-            v.visit(ref());
-        }
-
-        void acceptAt(Visitor& v, const std::string& key) const
-        {
-            const auto val = get(key);
-            if (val)
-            {
-                val->accept(v);
-            }
-            else
-            {
-                v.visit(Null());
-            }
-        }
-
-        table_t& ref()
-        {
-            return *this;
-        }
-
-        const table_t& ref() const
-        {
-            return *this;
-        }
-
-        /// Whether this table contains the key.
-        bool contains(const std::string& key) const
-        {
-            return !!get(key);
-        }
-
-        /// Count of keys.
-        size_t length() const
-        {
-            return table_.size();
-        }
-
-        /// Return all keys
-        /// TODO: Range
-        std::vector<std::string> keys() const
-        {
-            std::vector<std::string> keys;
-            keys.reserve(table_.size());
-            for (const auto& e : table_)
-            {
-                keys.emplace_back(e.first);
-            }
-            return keys;
-        }
-
-        /// From the key inside the table, return a mapped value as a 'T' type. 
-        template <class T>
-        const T& valueAs(const std::string& key) const
-        {
-            using Obj = ObjectType_t<T>;
-
-            if (!contains(key))
-            {
-                throw KeyNotFound();
-            }
-            if (!valueIs<T>(key))
-            {
-                throw MismatchType();
-            }
-            const auto val = std::dynamic_pointer_cast<const Obj>(get(key));
-            return val->ref();
-        }
-
-        template <class T>
-        T& valueAs(const std::string& key)
-        {
-            return const_cast<T&>(const_cast<const table_t&>(*this).template valueAs<T>(key));
-        }
-
-        /// Return true if the type of a value mapped by the key inside the table is 'T'.
-        /// The case of type mismatch or the key is not exists, return false.
-        template <class T>
-        bool valueIs(const std::string& key) const
-        {
-            const auto val = get(key);
-            return val && val->is(TypeTag<T>());
-        }
-
-        void addValue(const std::string& key, const std::shared_ptr<Value>& val)
-        {
-            table_.emplace(key, val);
-        }
-
-    private:
-        std::shared_ptr<const Value> get(const std::string& key) const
-        {
-            const auto found = table_.find(key);
-            if (found != std::cend(table_))
-            {
-                return found->second;
-            }
-            return nullptr;
-         }
-
-        std::shared_ptr<Value> get(const std::string& key)
-        {
-            return std::const_pointer_cast<Value>(const_cast<const table_t&>(*this).get(key));
-        }
-    };
-
-    /// From the key inside the table, return a mapped value as a 'T' type. 
-    template <class T>
-    const T& valueAs(const std::string& key, const table_t& t)
-    {
-        return t.template valueAs<T>(key);
-    }
-
-    /// ditto
-    template <class T>
-    const T& valueAs(const std::string& key, const std::shared_ptr<const table_t>& t)
-    {
-        return t->template valueAs<T>(key);
-    }
-
-    /// Return true if the type of a value mapped by the key inside the table is 'T'.
-    /// The case of type mismatch or the key is not exists, return false.
-    template <class T>
-    bool valueIs(const std::string& key, const table_t& t)
-    {
-        return t.template valueIs<T>(key);
-    }
-
-    /// ditto
-    template <class T>
-    bool valueIs(const std::string& key, const std::shared_ptr<const table_t>& t)
-    {
-        return t->template valueIs<T>(key);
-    }
-
-    /// Apply visitor for type safe processes.
-    inline void applyVisitorAt(Visitor& v, const std::string& key, const table_t& val)
-    {
-        val.acceptAt(v, key);
-    }
-
-    /// ditto
-    inline void applyVisitorAt(Visitor&& v, const std::string& key, const table_t& val)
-    {
-        val.acceptAt(v, key);
-    }
-
-    /// ditto
-    inline void applyVisitorAt(Visitor& v, const std::string& key, const std::shared_ptr<const table_t>& val)
-    {
-        val->acceptAt(v, key);
-    }
-
-    /// ditto
-    inline void applyVisitorAt(Visitor&& v, const std::string& key, const std::shared_ptr<const table_t>& val)
-    {
-        val->acceptAt(v, key);
-    }
-}
-
+#ifndef SML_SMLOBJ_H
+#define SML_SMLOBJ_H
+
+#include "smldef.h"
+#include "smlhash.h"
+#include "smlkey.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace sml
+{
+    namespace detail
+    {
+        class Deduplicator;
+        struct Release;
+    }
+
+    class Value
+    {
+    private:
+        ValueType type_;
+
+    protected:
+        explicit Value(ValueType type)
+            : type_(type)
+        {
+        }
+
+    public:
+        /// Return the type tag of this value.
+        ValueType type() const
+        {
+            return type_;
+        }
+
+        virtual bool is(TypeTag<integer_t>) const { return false; }
+        virtual bool is(TypeTag<real_t>) const { return false; }
+        virtual bool is(TypeTag<string_t>) const { return false; }
+        virtual bool is(TypeTag<array_t>) const { return false; }
+        virtual bool is(TypeTag<table_t>) const { return false; }
+        virtual void accept(Visitor& v) const {}
+    };
+
+    /// Return true if the type of the value is 'T'.
+    template <class T>
+    bool valueIs(const Value& val)
+    {
+        return val.is(TypeTag<T>());
+    }
+
+    /// Return the value as a 'T' type.
+    template <class T>
+    const T& valueAs(const Value& val)
+    {
+        if (!valueIs<T>(val))
+        {
+            throw MismatchType();
+        }
+        return static_cast<const ObjectType_t<T>&>(val).ref();
+    }
+
+    /// Apply visitor for type safe processes.
+    inline void applyVisitor(Visitor& v, const Value& val)
+    {
+        val.accept(v);
+    }
+
+    /// ditto
+    inline void applyVisitor(Visitor&& v, const Value& val)
+    {
+        val.accept(v);
+    }
+
+    class Integer : public Value
+    {
+        integer_t i_;
+
+    public:
+        Integer(integer_t i)
+            : Value(ValueType::Integer)
+            , i_(i)
+        {
+        }
+
+        bool is(TypeTag<integer_t>) const
+        {
+            return true;
+        }
+
+        void accept(Visitor& v) const
+        {
+            v.visit(ref());
+        }
+
+        integer_t& ref()
+        {
+            return i_;
+        }
+
+        const integer_t& ref() const
+        {
+            return i_;
+        }
+    };
+
+    class Real : public Value
+    {
+    private:
+        real_t r_;
+
+    public:
+        Real(real_t r)
+            : Value(ValueType::Real)
+            , r_(r)
+        {
+        }
+
+        bool is(TypeTag<real_t>) const
+        {
+            return true;
+        }
+
+        void accept(Visitor& v) const
+        {
+            v.visit(ref());
+        }
+
+        real_t& ref()
+        {
+            return r_;
+        }
+
+        const real_t& ref() const
+        {
+            return r_;
+        }
+    };
+
+    class String : public Value
+    {
+    private:
+        string_t s_;
+
+    public:
+        String(const std::string& s)
+            : Value(ValueType::String)
+            , s_(s)
+        {
+        }
+
+        bool is(TypeTag<string_t>) const
+        {
+            return true;
+        }
+
+        void accept(Visitor& v) const
+        {
+            v.visit(ref());
+        }
+
+        string_t& ref()
+        {
+            return s_;
+        }
+
+        const string_t& ref() const
+        {
+            return s_;
+        }
+    };
+
+    template <class T>
+    struct IsVector : std::false_type {};
+
+    template <class T, class A>
+    struct IsVector<std::vector<T, A>> : std::true_type {};
+
+    /// Type of array elements which are exported as a 'T' type
+    template <class T>
+    using SourceType_t = std::conditional_t<std::is_integral<T>::value, integer_t,
+        std::conditional_t<std::is_floating_point<T>::value, real_t, string_t>>;
+
+    /// Let the compiler assume the pointer is aligned to 'Align' bytes.
+    template <size_t Align, class T>
+    T* assumeAligned(T* p)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        if constexpr (Align > 1)
+        {
+            return static_cast<T*>(__builtin_assume_aligned(p, Align));
+        }
+#endif
+        return p;
+    }
+
+    /// Range over the array or table elements of an array.
+    template <class T>
+    class NodeRange
+    {
+    private:
+        using Base = std::vector<std::shared_ptr<Value>>::const_iterator;
+
+        Base begin_;
+        Base end_;
+
+    public:
+        class const_iterator
+        {
+        private:
+            Base it_;
+
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const T*;
+            using reference = const T&;
+
+            const_iterator() = default;
+
+            explicit const_iterator(Base it)
+                : it_(it)
+            {
+            }
+
+            const T& operator*() const
+            {
+                return static_cast<const T&>(**it_);
+            }
+
+            const T* operator->() const
+            {
+                return &**this;
+            }
+
+            const_iterator& operator++()
+            {
+                ++it_;
+                return *this;
+            }
+
+            const_iterator operator++(int)
+            {
+                const auto tmp = *this;
+                ++it_;
+                return tmp;
+            }
+
+            bool operator==(const const_iterator& rhs) const
+            {
+                return it_ == rhs.it_;
+            }
+
+            bool operator!=(const const_iterator& rhs) const
+            {
+                return it_ != rhs.it_;
+            }
+        };
+
+        NodeRange(Base b, Base e)
+            : begin_(b)
+            , end_(e)
+        {
+        }
+
+        const_iterator begin() const
+        {
+            return const_iterator(begin_);
+        }
+
+        const_iterator end() const
+        {
+            return const_iterator(end_);
+        }
+
+        const T& operator[](size_t i) const
+        {
+            return static_cast<const T&>(*begin_[i]);
+        }
+
+        /// Return the count of elements.
+        size_t size() const
+        {
+            return end_ - begin_;
+        }
+
+        bool empty() const
+        {
+            return begin_ == end_;
+        }
+    };
+
+    template <class T>
+    struct ArrayRangeOf
+    {
+        using type = span<const T>;
+    };
+
+    template <>
+    struct ArrayRangeOf<array_t>
+    {
+        using type = NodeRange<array_t>;
+    };
+
+    template <>
+    struct ArrayRangeOf<table_t>
+    {
+        using type = NodeRange<table_t>;
+    };
+
+    /// Range over the elements of an array as a 'T' type.
+    /// Elements of integer, real and string arrays are contiguous.
+    template <class T>
+    using ArrayRange = typename ArrayRangeOf<T>::type;
+
+    /// Row major view of a rectangular numeric array.
+    template <class T>
+    class NDView
+    {
+    private:
+        const T* data_;
+        span<const size_t> shape_;
+        span<const size_t> strides_;
+
+    public:
+        NDView(const T* data, span<const size_t> shape, span<const size_t> strides)
+            : data_(data)
+            , shape_(shape)
+            , strides_(strides)
+        {
+        }
+
+        /// Return the first element of the contiguous buffer.
+        const T* data() const
+        {
+            return data_;
+        }
+
+        /// Return the count of dimensions.
+        size_t rank() const
+        {
+            return shape_.size();
+        }
+
+        /// Return the length of each dimension.
+        span<const size_t> shape() const
+        {
+            return shape_;
+        }
+
+        /// Return the distance of the next element in each dimension, in elements.
+        span<const size_t> strides() const
+        {
+            return strides_;
+        }
+
+        /// Return the count of all elements.
+        size_t size() const
+        {
+            return shape_.empty() ? 0 : shape_[0] * strides_[0];
+        }
+
+        /// Return the element at the indices, one per dimension. Indices are not checked.
+        template <class... Idx>
+        const T& operator()(Idx... idx) const
+        {
+            size_t offset = 0;
+            size_t d = 0;
+            ((offset += static_cast<size_t>(idx) * strides_[d++]), ...);
+            return data_[offset];
+        }
+    };
+
+    /// Contiguous buffer of a rectangular numeric array, shared by the array and its rows.
+    struct DenseStorage
+    {
+        ValueType elementType;
+        std::vector<integer_t> integers;
+        std::vector<real_t> reals;
+        std::vector<size_t> shape;
+        std::vector<size_t> strides;
+        bool stale = false; // A row was modified, so the buffer no longer matches the nesting
+    };
+
+    /// Array type
+    /// Integers, reals and strings are stored contiguously by value,
+    /// arrays and tables are stored as nodes.
+    /// Rectangular nesting of integer or real arrays can be packed into one DenseStorage,
+    /// in which case the rows are views of it.
+    /// Modifying a row copies it out of the buffer and leaves the arrays sharing it unpacked.
+    class array_t : public Value
+    {
+    private:
+        ValueType elementType_ = ValueType::Null;
+        std::vector<integer_t> integers_;
+        std::vector<real_t> reals_;
+        std::vector<string_t> strings_;
+        std::vector<std::shared_ptr<Value>> nodes_;
+
+        std::shared_ptr<DenseStorage> dense_;
+        size_t dim_ = 0;
+        size_t offset_ = 0;
+
+        HashCache hash_;
+
+        friend class detail::Deduplicator;
+        friend struct detail::Release;
+
+    public:
+        array_t()
+            : Value(ValueType::Array)
+        {
+        }
+
+        array_t(const array_t&) = default;
+        array_t(array_t&&) = default;
+
+        array_t& operator=(const array_t&) = default;
+        array_t& operator=(array_t&&) = default;
+
+        /// Descendants are released from a worklist, so deep nesting does not overflow the stack.
+        ~array_t();
+
+        bool is(TypeTag<array_t>) const
+        {
+            return true;
+        }
+
+        void accept(Visitor& v) const
+        {
+            v.visit(ref());
+        }
+
+        void acceptAt(Visitor& v, size_t i) const
+        {
+            if (i >= length())
+            {
+                v.visit(Null());
+                return;
+            }
+
+            switch (elementType_)
+            {
+            case ValueType::Integer:
+                v.visit(elements(TypeTag<integer_t>())[i]);
+                break;
+            case ValueType::Real:
+                v.visit(elements(TypeTag<real_t>())[i]);
+                break;
+            case ValueType::String:
+                v.visit(elements(TypeTag<string_t>())[i]);
+                break;
+            default:
+                nodes_[i]->accept(v);
+                break;
+            }
+        }
+
+        /// Visit all elements. Integer, real and string arrays are passed as one span.
+        void acceptEach(Visitor& v) const
+        {
+            switch (elementType_)
+            {
+            case ValueType::Integer:
+                v.visit(elements(TypeTag<integer_t>()));
+                break;
+            case ValueType::Real:
+                v.visit(elements(TypeTag<real_t>()));
+                break;
+            case ValueType::String:
+                v.visit(elements(TypeTag<string_t>()));
+                break;
+            default:
+                for (const auto& e : nodes_)
+                {
+                    e->accept(v);
+                }
+                break;
+            }
+        }
+
+        array_t& ref()
+        {
+            return *this;
+        }
+
+        const array_t& ref() const
+        {
+            return *this;
+        }
+
+        /// Return the size of this array
+        size_t length() const
+        {
+            if (dense_)
+            {
+                return dense_->shape[dim_];
+            }
+
+            switch (elementType_)
+            {
+            case ValueType::Integer:
+                return integers_.size();
+            case ValueType::Real:
+                return reals_.size();
+            case ValueType::String:
+                return strings_.size();
+            default:
+                return nodes_.size();
+            }
+        }
+
+        /// Return the indexed value as a 'T' type. 
+        template <class T>
+        const T& valueAs(size_t i) const
+        {
+            if (!arrayIs<T>())
+            {
+                throw MismatchType();
+            }
+            const auto elems = elements(TypeTag<T>());
+            if (i >= elems.size())
+            {
+                throw std::out_of_range("array index out of range");
+            }
+            return elems[i];
+        }
+
+        template <class T>
+        T& valueAs(size_t i)
+        {
+            return const_cast<T&>(const_cast<const array_t&>(*this).template valueAs<T>(i));
+        }
+
+        /// Return true if the array type is 'T'.
+        template <class T>
+        bool arrayIs() const
+        {
+            return elementType_ == ValueTypeOf<T>::value;
+        }
+
+        /// Return the type tag of elements, or ValueType::Null if this array is empty.
+        ValueType elementType() const
+        {
+            return elementType_;
+        }
+
+        /// Return the range of all elements as a 'T' type.
+        /// An empty array is a range of any type.
+        template <class T>
+        ArrayRange<T> as() const
+        {
+            if (elementType_ != ValueType::Null && !arrayIs<T>())
+            {
+                throw MismatchType();
+            }
+            return elements(TypeTag<T>());
+        }
+
+        /// Copy all elements as a 'T' type into the buffer, converting each to 'Out'.
+        /// The buffer needs room for length() elements.
+        /// If 'Align' is given, the buffer is assumed to be aligned to 'Align' bytes.
+        template <class T, size_t Align = 0, class Out>
+        void copyTo(Out* out) const
+        {
+            static_assert(std::is_convertible<T, Out>::value, "elements are not convertible to the output type");
+
+            const auto src = as<T>();
+            const auto n = src.size();
+            const auto s = src.data();
+            const auto d = assumeAligned<Align>(out);
+
+            if constexpr (std::is_same<T, Out>::value)
+            {
+                std::copy(s, s + n, d);
+            }
+            else
+            {
+                // Plain loop, widening or narrowing is vectorized by the compiler.
+                for (size_t i = 0; i < n; ++i)
+                {
+                    d[i] = static_cast<Out>(s[i]);
+                }
+            }
+        }
+
+        /// Return the structural hash of the elements, computed at first and cached.
+        /// Equal arrays have equal hashes whether packed or not.
+        /// Modifying a descendant after hashing leaves this hash stale.
+        uint64_t hash() const;
+
+        /// Return true if this array is packed into a contiguous buffer.
+        bool packed() const
+        {
+            return !!packedStorage();
+        }
+
+        /// Return the N-dimensional view of a packed array of 'T'.
+        template <class T>
+        NDView<T> ndview() const
+        {
+            if (!packed() || dense_->elementType != ValueTypeOf<T>::value)
+            {
+                throw MismatchType();
+            }
+            const auto rank = dense_->shape.size() - dim_;
+            return NDView<T>(denseData(TypeTag<T>()) + offset_,
+                             span<const size_t>(dense_->shape.data() + dim_, rank),
+                             span<const size_t>(dense_->strides.data() + dim_, rank));
+        }
+
+        /// If elements are integer or real arrays which are equal in type and shape,
+        /// move all of them into one contiguous buffer and make the rows views of it.
+        /// Already packed rows are flattened, so packing bottom up packs any depth.
+        /// Return true if packed.
+        bool pack()
+        {
+            if (dense_ && dense_->stale)
+            {
+                unpack();
+            }
+            if (dense_ || elementType_ != ValueType::Array || nodes_.empty())
+            {
+                return false;
+            }
+
+            const auto& first = static_cast<const array_t&>(*nodes_.front());
+            const auto type = first.scalarType();
+            const auto subShape = first.shape();
+            if (type != ValueType::Integer && type != ValueType::Real)
+            {
+                return false;
+            }
+
+            for (const auto& e : nodes_)
+            {
+                const auto& row = static_cast<const array_t&>(*e);
+                if (row.scalarType() != type || !row.hasShape(subShape))
+                {
+                    return false;
+                }
+            }
+
+            const auto dense = std::make_shared<DenseStorage>();
+            dense->elementType = type;
+            dense->shape.reserve(subShape.size() + 1);
+            dense->shape.emplace_back(nodes_.size());
+            dense->shape.insert(std::cend(dense->shape), std::cbegin(subShape), std::cend(subShape));
+            dense->strides.resize(dense->shape.size());
+            size_t stride = 1;
+            for (size_t d = dense->shape.size(); d-- > 0;)
+            {
+                dense->strides[d] = stride;
+                stride *= dense->shape[d];
+            }
+
+            if (type == ValueType::Integer)
+            {
+                dense->integers.reserve(stride);
+            }
+            else
+            {
+                dense->reals.reserve(stride);
+            }
+            for (const auto& e : nodes_)
+            {
+                static_cast<const array_t&>(*e).flattenTo(*dense);
+            }
+
+            makeView(dense, 0, 0);
+            return true;
+        }
+
+        /// Return all elements as a vector of 'T'.
+        /// Integral types are read from integer arrays, floating point types from real arrays.
+        template <class T>
+        std::vector<T> toVector() const
+        {
+            std::vector<T> v(length());
+            copyTo<SourceType_t<T>>(v.data());
+            return v;
+        }
+
+        void insertBack(integer_t i)
+        {
+            unpack();
+            setElementType(ValueType::Integer);
+            hash_.reset();
+            integers_.emplace_back(i);
+        }
+
+        void insertBack(real_t r)
+        {
+            unpack();
+            setElementType(ValueType::Real);
+            hash_.reset();
+            reals_.emplace_back(r);
+        }
+
+        void insertBack(const string_t& s)
+        {
+            setElementType(ValueType::String);
+            hash_.reset();
+            strings_.emplace_back(s);
+        }
+
+        void insertBack(string_t&& s)
+        {
+            setElementType(ValueType::String);
+            hash_.reset();
+            strings_.emplace_back(std::move(s));
+        }
+
+        /// Integers, reals and strings are unwrapped and stored by value.
+        void insertBack(const std::shared_ptr<Value>& val)
+        {
+            switch (val->type())
+            {
+            case ValueType::Integer:
+                insertBack(static_cast<const Integer&>(*val).ref());
+                break;
+            case ValueType::Real:
+                insertBack(static_cast<const Real&>(*val).ref());
+                break;
+            case ValueType::String:
+                insertBack(static_cast<const String&>(*val).ref());
+                break;
+            default:
+                unpack();
+                setElementType(val->type());
+                nodes_.emplace_back(val);
+                hash_.reset();
+                break;
+            }
+        }
+
+        /// Replace the indexed array or table.
+        void setValue(size_t i, const std::shared_ptr<Value>& val)
+        {
+            if (i >= length())
+            {
+                throw std::out_of_range("array_t::setValue");
+            }
+            if (val->type() != elementType_ || !(elementType_ == ValueType::Array || elementType_ == ValueType::Table))
+            {
+                throw MismatchType();
+            }
+            unpack();
+            nodes_[i] = val;
+            hash_.reset();
+        }
+
+    private:
+        void setElementType(ValueType type)
+        {
+            if (elementType_ == ValueType::Null)
+            {
+                elementType_ = type;
+            }
+            else if (elementType_ != type)
+            {
+                throw MismatchType();
+            }
+        }
+
+        /// Element type of the innermost arrays if packed, otherwise of this array.
+        ValueType scalarType() const
+        {
+            return packed() ? dense_->elementType : elementType_;
+        }
+
+        /// Shape of this array if it is packed or a flat integer or real array.
+        std::vector<size_t> shape() const
+        {
+            if (packed())
+            {
+                return std::vector<size_t>(std::cbegin(dense_->shape) + dim_, std::cend(dense_->shape));
+            }
+            return std::vector<size_t>{ length() };
+        }
+
+        bool hasShape(const std::vector<size_t>& shape) const
+        {
+            if (packed())
+            {
+                return std::equal(std::cbegin(dense_->shape) + dim_, std::cend(dense_->shape),
+                                  std::cbegin(shape), std::cend(shape));
+            }
+            return shape.size() == 1 && shape[0] == length();
+        }
+
+        /// Append all elements in row major order.
+        void flattenTo(DenseStorage& dense) const
+        {
+            if (dense.elementType == ValueType::Integer)
+            {
+                const auto src = packed() ? ndview<integer_t>().data() : elements(TypeTag<integer_t>()).data();
+                const auto n = packed() ? ndview<integer_t>().size() : length();
+                dense.integers.insert(std::cend(dense.integers), src, src + n);
+            }
+            else
+            {
+                const auto src = packed() ? ndview<real_t>().data() : elements(TypeTag<real_t>()).data();
+                const auto n = packed() ? ndview<real_t>().size() : length();
+                dense.reals.insert(std::cend(dense.reals), src, src + n);
+            }
+        }
+
+        /// Make this array the view of the dimension 'dim' at the offset.
+        void makeView(const std::shared_ptr<DenseStorage>& dense, size_t dim, size_t offset)
+        {
+            dense_ = dense;
+            dim_ = dim;
+            offset_ = offset;
+            integers_ = std::vector<integer_t>();
+            reals_ = std::vector<real_t>();
+            nodes_ = std::vector<std::shared_ptr<Value>>();
+
+            if (dim + 1 == dense->shape.size())
+            {
+                elementType_ = dense->elementType;
+                return;
+            }
+
+            // All rows share one allocation, the nodes alias it.
+            elementType_ = ValueType::Array;
+            const auto n = dense->shape[dim];
+            const auto rows = std::make_shared<std::vector<array_t>>(n);
+            nodes_.reserve(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                auto& row = (*rows)[i];
+                row.makeView(dense, dim + 1, offset + i * dense->strides[dim]);
+                nodes_.emplace_back(rows, &row);
+            }
+        }
+
+        /// Stop sharing the packed buffer before modifying this array.
+        /// Modifying a row makes the buffer stale for the arrays above it.
+        void unpack()
+        {
+            if (!dense_)
+            {
+                return;
+            }
+            if (dim_ > 0)
+            {
+                dense_->stale = true;
+            }
+            if (elementType_ == ValueType::Integer)
+            {
+                const auto elems = elements(TypeTag<integer_t>());
+                integers_.assign(std::cbegin(elems), std::cend(elems));
+            }
+            else if (elementType_ == ValueType::Real)
+            {
+                const auto elems = elements(TypeTag<real_t>());
+                reals_.assign(std::cbegin(elems), std::cend(elems));
+            }
+            dense_.reset();
+            dim_ = 0;
+            offset_ = 0;
+        }
+
+        /// Buffer of this array if it still matches the nesting, otherwise nullptr.
+        const DenseStorage* packedStorage() const
+        {
+            return dense_ && !dense_->stale ? dense_.get() : nullptr;
+        }
+
+        integer_t* denseData(TypeTag<integer_t>) const
+        {
+            return dense_->integers.data();
+        }
+
+        real_t* denseData(TypeTag<real_t>) const
+        {
+            return dense_->reals.data();
+        }
+
+        span<const integer_t> elements(TypeTag<integer_t>) const
+        {
+            if (dense_)
+            {
+                return span<const integer_t>(dense_->integers.data() + offset_, dense_->shape[dim_]);
+            }
+            return span<const integer_t>(integers_.data(), integers_.size());
+        }
+
+        span<const real_t> elements(TypeTag<real_t>) const
+        {
+            if (dense_)
+            {
+                return span<const real_t>(dense_->reals.data() + offset_, dense_->shape[dim_]);
+            }
+            return span<const real_t>(reals_.data(), reals_.size());
+        }
+
+        span<const string_t> elements(TypeTag<string_t>) const
+        {
+            return span<const string_t>(strings_.data(), strings_.size());
+        }
+
+        template <class T>
+        NodeRange<T> elements(TypeTag<T>) const
+        {
+            return NodeRange<T>(std::cbegin(nodes_), std::cend(nodes_));
+        }
+    };
+
+    /// Return the indexed value as a 'T' type. 
+    template <class T>
+    const T& valueAs(size_t i, const array_t& a)
+    {
+        return a.template valueAs<T>(i);
+    }
+
+    /// Return true if the array type is 'T'.
+    template <class T>
+    bool arrayIs(const array_t& a)
+    {
+        return a.template arrayIs<T>();
+    }
+
+    /// Return the range of all elements as a 'T' type.
+    template <class T>
+    ArrayRange<T> as(const array_t& a)
+    {
+        return a.template as<T>();
+    }
+
+    /// Copy all elements as a 'T' type into the buffer, converting each to 'Out'.
+    template <class T, size_t Align = 0, class Out>
+    void copyTo(const array_t& a, Out* out)
+    {
+        a.template copyTo<T, Align>(out);
+    }
+
+    /// Return the N-dimensional view of a packed array of 'T'.
+    template <class T>
+    NDView<T> ndview(const array_t& a)
+    {
+        return a.template ndview<T>();
+    }
+
+    /// Apply visitor for type safe processes.
+    inline void applyVisitorAt(Visitor& v, size_t i, const array_t& val)
+    {
+        val.acceptAt(v, i);
+    }
+
+    /// ditto
+    inline void applyVisitorAt(Visitor&& v, size_t i, const array_t& val)
+    {
+        val.acceptAt(v, i);
+    }
+
+    /// Apply visitor to all elements of the array.
+    /// Integer, real and string arrays are passed by one call as a span.
+    inline void applyVisitorEach(Visitor& v, const array_t& val)
+    {
+        val.acceptEach(v);
+    }
+
+    /// ditto
+    inline void applyVisitorEach(Visitor&& v, const array_t& val)
+    {
+        val.acceptEach(v);
+    }
+
+    /// Ordered set of keys shared by tables which add the same keys in the same order.
+    /// A table uses a prefix of its shape, so a shape can be extended while shared.
+    /// Up to SmallSize keys are found by a linear scan of packed key prefixes,
+    /// larger shapes switch to an open addressing hash index.
+    class Shape
+    {
+    public:
+        /// Shapes up to this count of keys are not hashed.
+        static constexpr size_t SmallSize = 8;
+
+    private:
+        std::vector<Key> keys_;
+
+        // Length and the first 7 bytes of each of the first keys, scanned at once.
+        alignas(64) std::array<uint64_t, SmallSize> prefixes_ = {};
+
+        // Slot+1 of keys by the key hash, empty while the shape is small.
+        std::vector<uint32_t> index_;
+
+    public:
+        /// Count of keys.
+        size_t size() const
+        {
+            return keys_.size();
+        }
+
+        /// Return the key of the slot.
+        const Key& key(size_t slot) const
+        {
+            return keys_[slot];
+        }
+
+        /// Return the slot of the key, or size() if not found.
+        size_t slotOf(std::string_view key) const
+        {
+            if (index_.empty())
+            {
+                return findSmall(prefixOf(key), key);
+            }
+            return findHashed(hashBytes(key.data(), key.size()), key);
+        }
+
+        /// ditto
+        size_t slotOf(const Key& key) const
+        {
+            if (index_.empty())
+            {
+                return findSmall(prefixOf(key.str()), key);
+            }
+            return findHashed(key.hash(), key);
+        }
+
+        /// Add the key not exists to the end.
+        void append(const Key& key)
+        {
+            const auto i = keys_.size();
+            keys_.emplace_back(key);
+            if (i < SmallSize)
+            {
+                prefixes_[i] = prefixOf(key.str());
+            }
+            else if (index_.empty() || (i + 1) * 2 > index_.size())
+            {
+                rehash();
+            }
+            else
+            {
+                insertIndex(i);
+            }
+        }
+
+        /// Return a new shape of the first 'n' keys.
+        std::shared_ptr<Shape> prefix(size_t n) const
+        {
+            const auto s = std::make_shared<Shape>();
+            s->keys_.reserve(n + 1);
+            for (size_t i = 0; i < n; ++i)
+            {
+                s->append(keys_[i]);
+            }
+            return s;
+        }
+
+    private:
+        static uint64_t prefixOf(std::string_view key)
+        {
+            uint64_t p = 0;
+            std::memcpy(&p, key.data(), std::min<size_t>(key.size(), 7));
+            return (p << 8) | std::min<size_t>(key.size(), 255);
+        }
+
+        static bool keyEquals(const Key& a, std::string_view b)
+        {
+            return a.str() == b;
+        }
+
+        static bool keyEquals(const Key& a, const Key& b)
+        {
+            return a == b;
+        }
+
+        /// Return the bit mask of small keys whose prefix is 'p'.
+        unsigned matchPrefixes(uint64_t p) const
+        {
+#if defined(__AVX2__)
+            const auto k = _mm256_set1_epi64x(static_cast<long long>(p));
+            const auto a = _mm256_cmpeq_epi64(_mm256_load_si256(reinterpret_cast<const __m256i*>(prefixes_.data())), k);
+            const auto b = _mm256_cmpeq_epi64(_mm256_load_si256(reinterpret_cast<const __m256i*>(prefixes_.data() + 4)), k);
+            return static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(a))) |
+                   (static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(b))) << 4);
+#else
+            unsigned mask = 0;
+            for (size_t i = 0; i < SmallSize; ++i)
+            {
+                mask |= static_cast<unsigned>(prefixes_[i] == p) << i;
+            }
+            return mask;
+#endif
+        }
+
+        template <class K>
+        size_t findSmall(uint64_t prefix, const K& key) const
+        {
+            auto mask = matchPrefixes(prefix) & ((1u << keys_.size()) - 1);
+            for (size_t i = 0; mask; ++i, mask >>= 1)
+            {
+                if ((mask & 1) && keyEquals(keys_[i], key))
+                {
+                    return i;
+                }
+            }
+            return keys_.size();
+        }
+
+        template <class K>
+        size_t findHashed(uint64_t hash, const K& key) const
+        {
+            const auto m = index_.size() - 1;
+            for (auto pos = hash & m;; pos = (pos + 1) & m)
+            {
+                const auto i = index_[pos];
+                if (i == 0)
+                {
+                    return keys_.size();
+                }
+                if (keyEquals(keys_[i - 1], key))
+                {
+                    return i - 1;
+                }
+            }
+        }
+
+        void insertIndex(size_t i)
+        {
+            const auto m = index_.size() - 1;
+            auto pos = keys_[i].hash() & m;
+            while (index_[pos] != 0)
+            {
+                pos = (pos + 1) & m;
+            }
+            index_[pos] = static_cast<uint32_t>(i + 1);
+        }
+
+        /// Rebuild the index at most half full.
+        void rehash()
+        {
+            size_t capacity = SmallSize * 4;
+            while (capacity < keys_.size() * 4)
+            {
+                capacity *= 2;
+            }
+            index_.assign(capacity, 0);
+            for (size_t i = 0; i < keys_.size(); ++i)
+            {
+                insertIndex(i);
+            }
+        }
+    };
+
+    /// Key with an inline cache of its slot in the last looked up shape.
+    /// Repeated lookups over tables of one shape cost a shape compare and a slot load.
+    /// Not thread safe, use one per thread.
+    class CachedKey
+    {
+    private:
+        Key key_;
+        mutable std::shared_ptr<const Shape> shape_;
+        mutable size_t slot_ = 0;
+
+        friend class table_t;
+
+    public:
+        explicit CachedKey(std::string_view key)
+            : key_(key)
+        {
+        }
+
+        explicit CachedKey(const Key& key)
+            : key_(key)
+        {
+        }
+
+        const Key& key() const
+        {
+            return key_;
+        }
+    };
+
+    /// Table type
+    /// Entries are kept in insertion order.
+    /// Keys live in a shape, shared with tables which have the same keys in the same order,
+    /// and each table stores only its values.
+    class table_t : public Value
+    {
+    public:
+        /// Tables up to this count of keys are not hashed.
+        static constexpr size_t SmallSize = Shape::SmallSize;
+
+    private:
+        using Values = std::vector<std::shared_ptr<Value>>;
+
+        // Keys of the values are the first keys of the shape. Null while empty.
+        std::shared_ptr<Shape> shape_;
+        Values values_;
+
+        HashCache hash_;
+
+        friend class detail::Deduplicator;
+        friend struct detail::Release;
+
+    public:
+        /// Iterator over pairs of a key and a value mapped by it, in insertion order.
+        /// Dereferencing refers the table's own storage, nothing is copied.
+        class const_iterator
+        {
+        private:
+            const Shape* shape_ = nullptr;
+            Values::const_iterator it_;
+            size_t slot_ = 0;
+
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::pair<const std::string&, const Value&>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = value_type;
+
+            const_iterator() = default;
+
+            const_iterator(const Shape* shape, Values::const_iterator it, size_t slot)
+                : shape_(shape)
+                , it_(it)
+                , slot_(slot)
+            {
+            }
+
+            value_type operator*() const
+            {
+                return value_type(shape_->key(slot_).str(), **it_);
+            }
+
+            const_iterator& operator++()
+            {
+                ++it_;
+                ++slot_;
+                return *this;
+            }
+
+            const_iterator operator++(int)
+            {
+                const auto tmp = *this;
+                ++*this;
+                return tmp;
+            }
+
+            bool operator==(const const_iterator& rhs) const
+            {
+                return it_ == rhs.it_;
+            }
+
+            bool operator!=(const const_iterator& rhs) const
+            {
+                return it_ != rhs.it_;
+            }
+        };
+
+        table_t()
+            : Value(ValueType::Table)
+        {
+        }
+
+        table_t(const table_t&) = default;
+        table_t(table_t&&) = default;
+
+        table_t& operator=(const table_t&) = default;
+        table_t& operator=(table_t&&) = default;
+
+        /// Descendants are released from a worklist, so deep nesting does not overflow the stack.
+        ~table_t();
+
+        bool is(TypeTag<table_t>) const
+        {
+            return true;
+        }
+
+        void accept(Visitor& v) const
+        {
+            v.visit(ref());
+        }
+
+        void acceptAt(Visitor& v, const std::string& key) const
+        {
+            const auto val = find(key);
+            if (val)
+            {
+                val->accept(v);
+            }
+            else
+            {
+                v.visit(Null());
+            }
+        }
+
+        table_t& ref()
+        {
+            return *this;
+        }
+
+        const table_t& ref() const
+        {
+            return *this;
+        }
+
+        /// Whether this table contains the key.
+        bool contains(const std::string& key) const
+        {
+            return slotOf(key) < values_.size();
+        }
+
+        /// ditto
+        bool contains(const Key& key) const
+        {
+            return slotOf(key) < values_.size();
+        }
+
+        /// Return the value mapped by the key, or nullptr if not found.
+        const Value* find(const std::string& key) const
+        {
+            return at(slotOf(key));
+        }
+
+        /// ditto
+        const Value* find(const Key& key) const
+        {
+            return at(slotOf(key));
+        }
+
+        /// ditto
+        /// The slot found is cached in the key for the next table of the same shape.
+        const Value* find(const CachedKey& key) const
+        {
+            if (!shape_)
+            {
+                return nullptr;
+            }
+            if (key.shape_.get() != shape_.get())
+            {
+                key.slot_ = shape_->slotOf(key.key_);
+                key.shape_ = shape_;
+            }
+            return at(key.slot_);
+        }
+
+        /// Return the node mapped by the key to share it with another table, or nullptr if not found.
+        std::shared_ptr<const Value> node(const std::string& key) const
+        {
+            const auto slot = slotOf(key);
+            return slot < values_.size() ? values_[slot] : nullptr;
+        }
+
+        /// Count of keys.
+        size_t length() const
+        {
+            return values_.size();
+        }
+
+        /// Return the structural hash of the entries, computed at first and cached.
+        /// The hash does not depend on the order of keys.
+        /// Modifying a descendant after hashing leaves this hash stale.
+        uint64_t hash() const;
+
+        /// Return the shape of this table, or nullptr if empty.
+        /// Tables returning the same shape have the same keys at the same positions
+        /// as far as their lengths.
+        const Shape* shape() const
+        {
+            return shape_.get();
+        }
+
+        const_iterator begin() const
+        {
+            return const_iterator(shape_.get(), std::cbegin(values_), 0);
+        }
+
+        const_iterator end() const
+        {
+            return const_iterator(shape_.get(), std::cend(values_), values_.size());
+        }
+
+        /// Return copies of all keys.
+        /// Iterate the table itself to visit keys without allocation.
+        std::vector<std::string> keys() const
+        {
+            std::vector<std::string> keys;
+            keys.reserve(values_.size());
+            for (size_t i = 0; i < values_.size(); ++i)
+            {
+                keys.emplace_back(shape_->key(i).str());
+            }
+            return keys;
+        }
+
+        /// From the key inside the table, return a mapped value as a 'T' type. 
+        /// If 'T' is a std::vector, the mapped array is converted to a new vector in bulk.
+        template <class T, class K = std::string>
+        std::conditional_t<IsVector<T>::value, T, const T&> valueAs(const K& key) const
+        {
+            if constexpr (IsVector<T>::value)
+            {
+                return valueAs<array_t>(key).template toVector<typename T::value_type>();
+            }
+            else
+            {
+                return valueAsRef<T>(find(key));
+            }
+        }
+
+        template <class T, class K = std::string>
+        std::conditional_t<IsVector<T>::value, T, T&> valueAs(const K& key)
+        {
+            if constexpr (IsVector<T>::value)
+            {
+                return const_cast<const table_t&>(*this).template valueAs<T>(key);
+            }
+            else
+            {
+                return const_cast<T&>(const_cast<const table_t&>(*this).template valueAs<T>(key));
+            }
+        }
+
+        /// Return true if the type of a value mapped by the key inside the table is 'T'.
+        /// The case of type mismatch or the key is not exists, return false.
+        template <class T, class K = std::string>
+        bool valueIs(const K& key) const
+        {
+            const auto val = find(key);
+            return val && val->type() == ValueTypeOf<T>::value;
+        }
+
+        /// Start this empty table with the shape of another table.
+        /// Keys added in the same order as the other table then share its shape.
+        void adoptShape(const table_t& like)
+        {
+            if (values_.empty() && like.shape_)
+            {
+                shape_ = like.shape_;
+                values_.reserve(like.values_.size());
+            }
+        }
+
+        /// Return the key the shape expects to be added next, or nullptr.
+        const Key* nextKey() const
+        {
+            return shape_ && values_.size() < shape_->size() ? &shape_->key(values_.size()) : nullptr;
+        }
+
+        /// Map the value by the key. If the key already exists, nothing is changed.
+        void addValue(const std::string& key, const std::shared_ptr<Value>& val)
+        {
+            const auto next = nextKey();
+            if (next && next->str() == key)
+            {
+                values_.emplace_back(val);
+                hash_.reset();
+            }
+            else if (!contains(key))
+            {
+                insert(Key(key), val);
+            }
+        }
+
+        /// Map the value by the interned key. If the key already exists, nothing is changed.
+        void addValue(const Key& key, const std::shared_ptr<Value>& val)
+        {
+            const auto next = nextKey();
+            if (next && next->same(key))
+            {
+                values_.emplace_back(val);
+                hash_.reset();
+            }
+            else if (!contains(key))
+            {
+                insert(key, val);
+            }
+        }
+
+        /// Map the value by the key, replacing the value if the key already exists.
+        void setValue(const std::string& key, const std::shared_ptr<Value>& val)
+        {
+            const auto slot = slotOf(key);
+            if (slot < values_.size())
+            {
+                values_[slot] = val;
+                hash_.reset();
+            }
+            else
+            {
+                insert(Key(key), val);
+            }
+        }
+
+        /// Remove the key. Return false if not exists.
+        /// The keys after it are moved to a new shape.
+        bool removeValue(const std::string& key)
+        {
+            const auto slot = slotOf(key);
+            if (slot >= values_.size())
+            {
+                return false;
+            }
+
+            auto shape = shape_->prefix(slot);
+            for (auto i = slot + 1; i < values_.size(); ++i)
+            {
+                shape->append(shape_->key(i));
+            }
+            shape_ = std::move(shape);
+            values_.erase(std::cbegin(values_) + slot);
+            hash_.reset();
+            return true;
+        }
+
+    private:
+        void insert(const Key& key, const std::shared_ptr<Value>& val)
+        {
+            if (!shape_)
+            {
+                shape_ = std::make_shared<Shape>();
+            }
+            else if (values_.size() < shape_->size() || shape_.use_count() > 1)
+            {
+                // The shape differs from here, or others may read it.
+                shape_ = shape_->prefix(values_.size());
+            }
+            shape_->append(key);
+            values_.emplace_back(val);
+            hash_.reset();
+        }
+
+        template <class K>
+        size_t slotOf(const K& key) const
+        {
+            return shape_ ? shape_->slotOf(key) : 0;
+        }
+
+        const Value* at(size_t slot) const
+        {
+            return slot < values_.size() ? values_[slot].get() : nullptr;
+        }
+
+        template <class T>
+        static const T& valueAsRef(const Value* val)
+        {
+            if (!val)
+            {
+                throw KeyNotFound();
+            }
+            if (val->type() != ValueTypeOf<T>::value)
+            {
+                throw MismatchType();
+            }
+            return static_cast<const ObjectType_t<T>&>(*val).ref();
+        }
+    };
+
+    namespace detail
+    {
+        /// Hash of a real by its value, so 0.0 and -0.0 hash alike, and so do all NaNs.
+        inline uint64_t hashReal(real_t r)
+        {
+            if (r == 0)
+            {
+                r = 0;
+            }
+            else if (r != r)
+            {
+                r = std::numeric_limits<real_t>::quiet_NaN();
+            }
+            return hashBytes(&r, sizeof(r));
+        }
+
+        /// Equality of reals matching hashReal(), where NaN equals NaN.
+        inline bool sameReal(real_t a, real_t b)
+        {
+            return a == b || (a != a && b != b);
+        }
+    }
+
+    /// Return the structural hash of the value.
+    /// Equal values have equal hashes. Hashes of tables and arrays are cached.
+    /// Reals are hashed by value, so 0.0 and -0.0 hash alike, and so do all NaNs.
+    inline uint64_t structuralHash(const Value& val)
+    {
+        const auto tag = static_cast<uint64_t>(val.type());
+        switch (val.type())
+        {
+        case ValueType::Integer:
+            return hashCombine(tag, static_cast<uint64_t>(static_cast<const Integer&>(val).ref()));
+        case ValueType::Real:
+            return hashCombine(tag, detail::hashReal(static_cast<const Real&>(val).ref()));
+        case ValueType::String:
+        {
+            const auto& s = static_cast<const String&>(val).ref();
+            return hashCombine(tag, hashBytes(s.data(), s.size()));
+        }
+        case ValueType::Array:
+            return static_cast<const array_t&>(val).hash();
+        case ValueType::Table:
+            return static_cast<const table_t&>(val).hash();
+        default:
+            return tag;
+        }
+    }
+
+    namespace detail
+    {
+        /// Releases nodes without recursion.
+        /// A child owned only by its parent is moved to the worklist, and its own children are
+        /// taken out before it is destroyed, so each destructor finds no children to release.
+        struct Release
+        {
+            using Nodes = std::vector<std::shared_ptr<Value>>;
+
+            static void run(Nodes& nodes)
+            {
+                Nodes work;
+                take(nodes, work);
+                while (!work.empty())
+                {
+                    auto node = std::move(work.back());
+                    work.pop_back();
+                    if (node->type() == ValueType::Table)
+                    {
+                        take(static_cast<table_t&>(*node).values_, work);
+                    }
+                    else if (node->type() == ValueType::Array)
+                    {
+                        take(static_cast<array_t&>(*node).nodes_, work);
+                    }
+                }
+            }
+
+            static void take(Nodes& nodes, Nodes& work)
+            {
+                for (auto& n : nodes)
+                {
+                    if (n.use_count() == 1 && (n->type() == ValueType::Table || n->type() == ValueType::Array))
+                    {
+                        work.emplace_back(std::move(n));
+                    }
+                }
+                nodes.clear();
+            }
+        };
+    }
+
+    inline array_t::~array_t()
+    {
+        if (!nodes_.empty())
+        {
+            detail::Release::run(nodes_);
+        }
+    }
+
+    inline table_t::~table_t()
+    {
+        if (!values_.empty())
+        {
+            detail::Release::run(values_);
+        }
+    }
+
+    inline uint64_t array_t::hash() const
+    {
+        return hash_.get([this] {
+            auto h = hashCombine(static_cast<uint64_t>(ValueType::Array), length());
+            h = hashCombine(h, static_cast<uint64_t>(elementType_));
+            switch (elementType_)
+            {
+            case ValueType::Integer:
+            {
+                const auto e = elements(TypeTag<integer_t>());
+                return hashCombine(h, hashBytes(e.data(), e.size() * sizeof(integer_t)));
+            }
+            case ValueType::Real:
+                for (const auto r : elements(TypeTag<real_t>()))
+                {
+                    h = hashCombine(h, detail::hashReal(r));
+                }
+                return h;
+            case ValueType::String:
+                for (const auto& s : strings_)
+                {
+                    h = hashCombine(h, hashBytes(s.data(), s.size()));
+                }
+                return h;
+            default:
+                for (const auto& e : nodes_)
+                {
+                    h = hashCombine(h, structuralHash(*e));
+                }
+                return h;
+            }
+        });
+    }
+
+    inline uint64_t table_t::hash() const
+    {
+        return hash_.get([this] {
+            // Sum of entry hashes, so the order of keys does not matter.
+            uint64_t sum = 0;
+            for (size_t i = 0; i < values_.size(); ++i)
+            {
+                sum += hashCombine(shape_->key(i).hash(), structuralHash(*values_[i]));
+            }
+            return hashCombine(hashCombine(static_cast<uint64_t>(ValueType::Table), values_.size()), sum);
+        });
+    }
+
+    /// Return true if both values have equal contents.
+    /// Subtrees are skipped if they are the same node or their hashes differ.
+    /// Tables are equal regardless of the order of keys. Reals compare by value,
+    /// except that NaN equals NaN.
+    inline bool equal(const Value& a, const Value& b)
+    {
+        if (&a == &b)
+        {
+            return true;
+        }
+        if (a.type() != b.type() || structuralHash(a) != structuralHash(b))
+        {
+            return false;
+        }
+
+        switch (a.type())
+        {
+        case ValueType::Integer:
+            return static_cast<const Integer&>(a).ref() == static_cast<const Integer&>(b).ref();
+        case ValueType::Real:
+            return detail::sameReal(static_cast<const Real&>(a).ref(), static_cast<const Real&>(b).ref());
+        case ValueType::String:
+            return static_cast<const String&>(a).ref() == static_cast<const String&>(b).ref();
+        case ValueType::Array:
+        {
+            const auto& x = static_cast<const array_t&>(a);
+            const auto& y = static_cast<const array_t&>(b);
+            if (x.length() != y.length() || x.elementType() != y.elementType())
+            {
+                return false;
+            }
+            const auto same = [](auto r, auto s) { return std::equal(std::cbegin(r), std::cend(r), std::cbegin(s)); };
+            const auto deep = [](auto r, auto s) {
+                return std::equal(std::cbegin(r), std::cend(r), std::cbegin(s),
+                                  [](const Value& l, const Value& m) { return equal(l, m); });
+            };
+            switch (x.elementType())
+            {
+            case ValueType::Integer:
+                return same(x.as<integer_t>(), y.as<integer_t>());
+            case ValueType::Real:
+            {
+                const auto r = x.as<real_t>();
+                return std::equal(std::cbegin(r), std::cend(r), std::cbegin(y.as<real_t>()), detail::sameReal);
+            }
+            case ValueType::String:
+                return same(x.as<string_t>(), y.as<string_t>());
+            case ValueType::Array:
+                return deep(x.as<array_t>(), y.as<array_t>());
+            case ValueType::Table:
+                return deep(x.as<table_t>(), y.as<table_t>());
+            default:
+                return true;
+            }
+        }
+        case ValueType::Table:
+        {
+            const auto& x = static_cast<const table_t&>(a);
+            const auto& y = static_cast<const table_t&>(b);
+            if (x.length() != y.length())
+            {
+                return false;
+            }
+            for (const auto e : x)
+            {
+                const auto other = y.find(e.first);
+                if (!other || !equal(e.second, *other))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return true;
+        }
+    }
+
+    /// From the key inside the table, return a mapped value as a 'T' type. 
+    template <class T>
+    decltype(auto) valueAs(const std::string& key, const table_t& t)
+    {
+        return t.template valueAs<T>(key);
+    }
+
+    /// ditto
+    template <class T>
+    decltype(auto) valueAs(const std::string& key, const std::shared_ptr<const table_t>& t)
+    {
+        return t->template valueAs<T>(key);
+    }
+
+    /// ditto
+    template <class T>
+    decltype(auto) valueAs(const CachedKey& key, const table_t& t)
+    {
+        return t.template valueAs<T>(key);
+    }
+
+    /// Return true if the type of a value mapped by the key inside the table is 'T'.
+    /// The case of type mismatch or the key is not exists, return false.
+    template <class T>
+    bool valueIs(const std::string& key, const table_t& t)
+    {
+        return t.template valueIs<T>(key);
+    }
+
+    /// ditto
+    template <class T>
+    bool valueIs(const std::string& key, const std::shared_ptr<const table_t>& t)
+    {
+        return t->template valueIs<T>(key);
+    }
+
+    /// ditto
+    template <class T>
+    bool valueIs(const CachedKey& key, const table_t& t)
+    {
+        return t.template valueIs<T>(key);
+    }
+
+    /// Apply visitor for type safe processes.
+    inline void applyVisitorAt(Visitor& v, const std::string& key, const table_t& val)
+    {
+        val.acceptAt(v, key);
+    }
+
+    /// ditto
+    inline void applyVisitorAt(Visitor&& v, const std::string& key, const table_t& val)
+    {
+        val.acceptAt(v, key);
+    }
+
+    /// ditto
+    inline void applyVisitorAt(Visitor& v, const std::string& key, const std::shared_ptr<const table_t>& val)
+    {
+        val->acceptAt(v, key);
+    }
+
+    /// ditto
+    inline void applyVisitorAt(Visitor&& v, const std::string& key, const std::shared_ptr<const table_t>& val)
+    {
+        val->acceptAt(v, key);
+    }
+}
+
 #endif
\ No newline at end of file
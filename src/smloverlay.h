@@ -0,0 +1,237 @@
+#ifndef SML_SMLOVERLAY_H
+#define SML_SMLOVERLAY_H
+
+#include "smldef.h"
+#include "smlobj.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace sml
+{
+    /// Stack of documents viewed as one, without copying any of them.
+    /// A path joins keys by '.', such as "db.port", and resolves in the topmost layer having it,
+    /// so tables are merged key by key. Layers are shared, many overlays can stack one base document.
+    ///
+    /// Reading is safe from multiple threads. Modifying the overlay is not safe while reading.
+    class Overlay
+    {
+    public:
+        using Layer = std::shared_ptr<const table_t>;
+
+    private:
+        // Bottom first
+        std::vector<Layer> layers_;
+        uint64_t generation_ = 0;
+
+        // Flattened paths, resolved again when a layer changes
+        std::unordered_map<std::string, const Value*> flat_;
+
+    public:
+        Overlay() = default;
+
+        /// Stack the layers, the bottom first.
+        explicit Overlay(std::vector<Layer> layers)
+            : layers_(std::move(layers))
+        {
+            for (const auto& layer : layers_)
+            {
+                if (!layer)
+                {
+                    throw std::invalid_argument("Overlay layer is null");
+                }
+            }
+        }
+
+        /// Count of layers.
+        size_t size() const
+        {
+            return layers_.size();
+        }
+
+        /// Return the layer of the index, 0 for the bottom.
+        const Layer& layer(size_t i) const
+        {
+            return layers_.at(i);
+        }
+
+        /// Count of changes of layers.
+        uint64_t generation() const
+        {
+            return generation_;
+        }
+
+        /// Stack the layer on the top.
+        void push(Layer layer)
+        {
+            if (!layer)
+            {
+                throw std::invalid_argument("Overlay layer is null");
+            }
+            layers_.emplace_back(std::move(layer));
+            changed();
+        }
+
+        /// Replace the layer of the index, such as by a reloaded snapshot.
+        /// Only the flattened paths are resolved again, nothing else is cached.
+        void replace(size_t i, Layer layer)
+        {
+            if (!layer)
+            {
+                throw std::invalid_argument("Overlay layer is null");
+            }
+            layers_.at(i) = std::move(layer);
+            changed();
+        }
+
+        /// Resolve the path once and keep the value, so the next lookups of it cost one hash lookup.
+        /// Suits paths read on hot paths. Return false if the path is not found.
+        bool flatten(const std::string& path)
+        {
+            const auto val = resolve(path);
+            flat_[path] = val;
+            return val != nullptr;
+        }
+
+        /// Return the value of the path in the topmost layer having it, or nullptr if not found.
+        /// A table returned is of that layer only, use at() to merge it with the lower layers.
+        const Value* find(const std::string& path) const
+        {
+            if (!flat_.empty())
+            {
+                const auto found = flat_.find(path);
+                if (found != std::cend(flat_))
+                {
+                    return found->second;
+                }
+            }
+            return resolve(path);
+        }
+
+        /// Whether any layer contains the path.
+        bool contains(const std::string& path) const
+        {
+            return find(path) != nullptr;
+        }
+
+        /// Return the value of the path as a 'T' type.
+        /// Throw KeyNotFound if not found, MismatchType if the type is not 'T'.
+        template <class T>
+        std::conditional_t<IsVector<T>::value, T, const T&> valueAs(const std::string& path) const
+        {
+            const auto val = find(path);
+            if (!val)
+            {
+                throw KeyNotFound("key not found (" + path + ")");
+            }
+            if constexpr (IsVector<T>::value)
+            {
+                return sml::valueAs<array_t>(*val).template toVector<typename T::value_type>();
+            }
+            else
+            {
+                return sml::valueAs<T>(*val);
+            }
+        }
+
+        /// Return true if the value of the path is a 'T' type.
+        template <class T>
+        bool valueIs(const std::string& path) const
+        {
+            const auto val = find(path);
+            return val && sml::valueIs<T>(*val);
+        }
+
+        /// Return the overlay of the tables at the path of each layer having it.
+        /// The tables are shared with the layers, nothing is copied.
+        Overlay at(const std::string& path) const
+        {
+            Overlay sub;
+            for (const auto& layer : layers_)
+            {
+                std::shared_ptr<const Value> node = layer;
+                size_t b = 0;
+                for (;;)
+                {
+                    const auto e = (std::min)(path.find('.', b), path.size());
+                    node = static_cast<const table_t&>(*node).node(path.substr(b, e - b));
+                    if (!node || e == path.size() || !sml::valueIs<table_t>(*node))
+                    {
+                        break;
+                    }
+                    b = e + 1;
+                }
+                if (node && sml::valueIs<table_t>(*node))
+                {
+                    sub.layers_.emplace_back(std::static_pointer_cast<const table_t>(node));
+                }
+            }
+            return sub;
+        }
+
+        /// Return the keys of the top level of all layers, in the order found from the bottom.
+        std::vector<std::string> keys() const
+        {
+            std::vector<std::string> keys;
+            std::unordered_set<std::string> seen;
+            for (const auto& layer : layers_)
+            {
+                for (const auto e : *layer)
+                {
+                    if (seen.emplace(e.first).second)
+                    {
+                        keys.emplace_back(e.first);
+                    }
+                }
+            }
+            return keys;
+        }
+
+    private:
+        const Value* resolve(const std::string& path) const
+        {
+            std::string key;
+            for (auto layer = layers_.rbegin(); layer != layers_.rend(); ++layer)
+            {
+                const table_t* table = layer->get();
+                size_t b = 0;
+                for (;;)
+                {
+                    const auto e = (std::min)(path.find('.', b), path.size());
+                    key.assign(path, b, e - b);
+                    const auto val = table->find(key);
+                    if (val && e == path.size())
+                    {
+                        return val;
+                    }
+                    if (!val || !sml::valueIs<table_t>(*val))
+                    {
+                        break;
+                    }
+                    table = static_cast<const table_t*>(val);
+                    b = e + 1;
+                }
+            }
+            return nullptr;
+        }
+
+        void changed()
+        {
+            ++generation_;
+            for (auto& e : flat_)
+            {
+                e.second = resolve(e.first);
+            }
+        }
+    };
+}
+
+#endif
@@ -1,513 +1,669 @@
-#ifndef SML_SMLPARSE_H
-#define SML_SMLPARSE_H
-
-#include "smldef.h"
-#include "smlobj.h"
-#include <memory>
-#include <string>
-#include <fstream>
-#include <queue>
-
-namespace sml
-{
-    // Parser
-    struct Parser
-    {
-        // Consume front characters while the pred is true.
-        template <class It, class Pred>
-        void forward(It& b, It e, Pred p)
-        {
-            while (b != e && p(*b))
-            {
-                ++b;
-            }
-        }
-
-        // Consume back characters while the pred is true.
-        template <class It, class Pred>
-        void backward(It b, It& e, Pred p)
-        {
-            while (b != e && p(*(e - 1)))
-            {
-                --e;
-            }
-        }
-
-        // Consume front whitespaces
-        template <class It>
-        void consumeWhitespace(It& b, It e)
-        {
-            forward(b, e, [](char c) { return c == ' ' || c == '\t'; });
-        }
-
-        // <key> = <value>
-        template <class It>
-        void parse_key_eq_value(It& it, It end, table_t* table)
-        {
-            consumeWhitespace(it, end);
-            const auto key = parse_key(it, end, table);
-
-            ++it; // Skip '='.
-            consumeWhitespace(it, end);
-            const auto val = parse_value(it, end);
-
-            table->addValue(key, val);
-        }
-
-        template <class It>
-        std::string parse_key(It& it, It end, table_t* table)
-        {
-            const It keyB = it;
-            forward(it, end, [](char c) { return c != ' ' && c != '\t' && c != '='; });
-            const It keyE = it;
-            if (it == end)
-            {
-                throw ParseException("Unexpected EOL.");
-            }
-
-            const std::string key(keyB, keyE);
-            if (table->contains(key))
-            {
-                throw ParseException("Key duplicated (" + key + ")");
-            }
-
-            forward(it, end, [](char c) { return c != '='; });
-            if (it == end)
-            {
-                throw ParseException("Unexpected EOL.");
-            }
-
-            return key;
-        }
-
-        template <class It>
-        std::shared_ptr<Value> parse_value(It& it, It end)
-        {
-            if (it == end)
-            {
-                throw ParseException("Unexpected EOL.");
-            }
-
-            if (isInteger(it, end))
-            {
-                return parse_integer(it, end);
-            }
-            else if (isReal(it, end))
-            {
-                return parse_real(it, end);
-            }
-            else if (isString(it, end))
-            {
-                return parse_string(it, end);
-            }
-            else if (isArray(it, end))
-            {
-                return parse_array(it, end);
-            }
-
-            throw ParseException("Unexpected right value.");
-        }
-
-        template <class It>
-        std::shared_ptr<Integer> parse_integer(It& it, It end)
-        {
-            int sign = 1;
-            if (*it == '+' || *it == '-')
-            {
-                sign = *it == '+' ? 1 : -1;
-                ++it; // Skip '+' or '-'
-            }
-
-            const It b = it;
-            forward(it, end, [](char c) { return '0' <= c && c <= '9'; });
-            const It e = it;
-
-            integer_t i = std::stoi(std::string(b, e));
-            i *= sign;
-
-            return std::make_shared<Integer>(i);
-        }
-
-        template <class It>
-        std::shared_ptr<Real> parse_real(It& it, It end)
-        {
-            int sign = 1;
-            if (*it == '+' || *it == '-')
-            {
-                sign = *it == '+' ? 1 : -1;
-                ++it; // Skip '+' or '-'
-            }
-
-            const It b = it;
-            forward(it, end, [](char c) { return '0' <= c && c <= '9'; });
-            ++it; // Skip '.'
-            forward(it, end, [](char c) { return '0' <= c && c <= '9'; });
-            const It e = it;
-
-#ifdef SML_DOUBLE
-            auto r = std::stod(std::string(b, e));
-#else
-            auto r = std::stof(std::string(b, e));
-#endif
-
-            r *= sign;
-
-            return std::make_shared<Real>(r);
-        }
-
-        template <class It>
-        std::shared_ptr<String> parse_string(It& it, It end)
-        {
-            ++it; // Skip '\"'
-
-            const It b = it;
-            forward(it, end, [](char c) { return c != '\"'; });
-            const It e = it;
-            ++it; // Skip '\"'
-
-            std::string s(b, e);
-            return std::make_shared<String>(s);
-        }
-
-        template <class It>
-        std::shared_ptr<array_t> parse_array(It& it, It end)
-        {
-            It tmp = it;
-            ++tmp;
-            consumeWhitespace(tmp, end);
-
-            if (isInteger(tmp, end))
-            {
-                return parse_array(it, end, [&](It& i, It e) { return parse_integer(i, e); });
-            }
-            else if (isReal(tmp, end))
-            {
-                return parse_array(it, end, [&](It& i, It e) { return parse_real(i, e); });
-            }
-            else if (isString(tmp, end))
-            {
-                return parse_array(it, end, [&](It& i, It e) { return parse_string(i, e); });
-            }
-            else if (isArray(tmp, end))
-            {
-                return parse_array(it, end, [&](It& i, It e) { return parse_array(i, e); });
-            }
-
-            throw ParseException("Invalid array format.");
-        }
-
-        template <class It, class ElemParser>
-        std::shared_ptr<array_t> parse_array(It& it, It end, ElemParser efun)
-        {
-            const auto arr = std::make_shared<array_t>();
-
-            while (*it != ']')
-            {
-                ++it; // Skip '[' or ','
-                consumeWhitespace(it, end);
-
-                const auto elem = efun(it, end);
-                arr->insertBack(elem);
-
-                consumeWhitespace(it, end);
-            }
-            ++it; // Skip ']'
-
-            return arr;
-        }
-
-        template <class It>
-        bool isInteger(It it, It end)
-        {
-            if (*it == '+' || *it == '-')
-            {
-                ++it; // Skip '+' or '-'
-            }
-            if (it == end)
-            {
-                return false;
-            }
-            if (*it == '0')
-            {
-                return false;
-            }
-
-            const It b = it;
-            forward(it, end, [](char c) { return '0' <= c && c <= '9'; });
-            if (it != end && *it == '.') // This is a real.
-            {
-                return false;
-            }
-            return !std::string(b, it).empty();
-        }
-
-        template <class It>
-        bool isReal(It it, It end)
-        {
-            if (*it == '+' || *it == '-')
-            {
-                ++it; // Skip '+' or '-'
-            }
-            if (it == end)
-            {
-                return false;
-            }
-
-            const It b = it;
-            forward(it, end, [](char c) { return '0' <= c && c <= '9'; });
-            if (it == end || *it != '.')
-            {
-                return false;
-            }
-            ++it; // Skip '.'
-            forward(it, end, [](char c) { return '0' <= c && c <= '9'; });
-
-            return std::string(b, it) != ".";
-        }
-
-        template <class It>
-        bool isString(It it, It end)
-        {
-            if (*it != '\"')
-            {
-                return false;
-            }
-            ++it; // Skip '\"'
-            forward(it, end, [](char c) { return c != '\"'; });
-            return it != end;
-        }
-
-        template <class It>
-        bool isArray(It it, It end)
-        {
-            if (*it != '[')
-            {
-                return false;
-            }
-
-            ++it; // Skip '['
-            size_t level = 1;
-            forward(it, end, [&](char c) {
-                if (c == '[')
-                {
-                    ++level;
-                }
-                else if (c == ']')
-                {
-                    --level;
-                }
-                return level > 0;
-            });
-
-            return it != end && *it == ']';
-        }
-
-        // [<table key>]
-        template <class It>
-        table_t* parse_table(It& it, It end, table_t* root)
-        {
-            consumeWhitespace(it, end);
-            if (it == end)
-            {
-                throw ParseException("Unexpected EOL.");
-            }
-
-            const auto isTableArray = *it == '+';
-            if (isTableArray)
-            {
-                ++it;
-            }
-
-            if (*it != '[')
-            {
-                throw ParseException("Unexpected character \'" + *it + std::string("\'."));
-            }
-
-            // Parse table path
-            std::queue<std::string> path;
-
-            while (*it != ']')
-            {
-                ++it; // Skip '[' or '.'.
-                consumeWhitespace(it, end);
-
-                const It keyB = it;
-                forward(it, end, [](char c) { return c != ' ' && c != '\t' && c != '.' && c != ']'; });
-                const It keyE = it;
-                if (it == end)
-                {
-                    throw ParseException("Unexpected EOL.");
-                }
-
-                const std::string key(keyB, keyE);
-                if (key.empty())
-                {
-                    throw ParseException("Unexpected character \'" + *it + std::string("\'."));
-                }
-
-                path.push(key);
-
-                if (*it == ' ' || *it == '\t')
-                {
-                    forward(it, end, [](char c) { return c != '.' && c != ']'; });
-                    if (it == end)
-                    {
-                        throw ParseException("Unexpected EOL.");
-                    }
-                }
-            }
-
-            ++it; // Skip ']'.
-
-            // Create new table from path
-            std::string fullpath;
-            table_t* cur = root;
-            while (path.size() > 1)
-            {
-                const auto key = path.front();
-                path.pop();
-
-                if (!fullpath.empty())
-                {
-                    fullpath += ".";
-                }
-                fullpath += key;
-
-                if (valueIs<array_t>(key, *cur))
-                {
-                    auto& arr = cur->template valueAs<array_t>(key);
-                    if (!arrayIs<table_t>(arr))
-                    {
-                        throw ParseException("Key is not defined (" + fullpath + ").");
-                    }
-                    cur = &(arr.template valueAs<table_t>(arr.length() - 1));
-                }
-                else if (valueIs<table_t>(key, *cur))
-                {
-                    cur = &(cur->template valueAs<table_t>(key));
-                }
-                else
-                {
-                    throw ParseException("Key is not defined (" + fullpath + ").");
-                }
-            }
-
-            const auto key = path.front();
-            const auto newTable = std::make_shared<table_t>();
-
-            if (!fullpath.empty())
-            {
-                fullpath += ".";
-            }
-            fullpath += key;
-
-            if (isTableArray)
-            {
-                if (!cur->contains(key))
-                {
-                    const auto arr = std::make_shared<array_t>();
-                    cur->addValue(key, arr);
-                    arr->insertBack(newTable);
-                }
-                else
-                {
-                    if (!valueIs<array_t>(key, *cur))
-                    {
-                        throw ParseException("Key is not defined (" + fullpath + ").");
-                    }
-
-                    auto& arr = cur->template valueAs<array_t>(key);
-                    if (!arrayIs<table_t>(arr))
-                    {
-                        throw ParseException("Key is not defined (" + fullpath + ").");
-                    }
-
-                    arr.insertBack(newTable);
-                }
-            }
-            else
-            {
-                if (cur->contains(key))
-                {
-                    throw ParseException("Key duplicated (" + fullpath + ")");
-                }
-                cur->addValue(key, newTable);
-            }
-
-            return newTable.get();
-        }
-
-        std::shared_ptr<const table_t> parse(const std::string& path)
-        {
-            std::ifstream in;
-
-            in.open(path);
-            if (!in.is_open())
-            {
-                throw ParseException("Failed to open file (" + path + ")");
-            }
-
-            struct Closer
-            {
-                std::ifstream* in;
-                ~Closer()
-                {
-                    in->close();
-                }
-            };
-            Closer closer{ &in };
-
-            const auto rootTable = std::make_shared<table_t>();
-            table_t* currentTable = rootTable.get();
-
-            std::string line;
-            while (!in.eof())
-            {
-                std::getline(in, line);
-
-                auto it = std::cbegin(line);
-                auto end = std::cend(line);
-
-                // Erase front whitespaces.
-                consumeWhitespace(it, end);
-
-                if (it == end || *it == '#')
-                {
-                    continue;
-                }
-
-                if (*it == '[' || *it == '+')
-                {
-                    // (+)[<table key>]
-                    // Create new table
-                    currentTable = parse_table(it, end, rootTable.get());
-                }
-                else
-                {
-                    // <key> = <value>
-                    // Parse pair of key and value
-                    parse_key_eq_value(it, end, currentTable);
-                }
-
-                // After that the parse, the line need to be empty
-                consumeWhitespace(it, end);
-                if (it != end && *it != '#')
-                {
-                    throw ParseException(std::string("Unexpected character \'" + *it + std::string("\'.")));
-                }
-            }
-
-            return rootTable;
-        }
-    };
-
-    using ParseResult = table_t;
-
-    /// Parse a .sml file
-    inline std::shared_ptr<const ParseResult> parse(const std::string& path)
-    {
-        return Parser().parse(path);
-    }
-}
-
-#endif
+#ifndef SML_SMLPARSE_H
+#define SML_SMLPARSE_H
+
+#include "smldedup.h"
+#include "smldef.h"
+#include "smlkey.h"
+#include "smlobj.h"
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <queue>
+#include <unordered_map>
+
+namespace sml
+{
+    /// Options of parse.
+    struct ParseOptions
+    {
+        /// Pool to intern keys into, shared with other documents.
+        /// If null, keys are shared only inside the document.
+        std::shared_ptr<KeyPool> keys;
+
+        /// Make identical values and subtrees share one node after parsing.
+        bool dedup = false;
+
+        /// Receives the result of dedup if not null.
+        DedupStats* dedupStats = nullptr;
+    };
+
+    namespace detail
+    {
+        // Scanning of characters shared by the parsers.
+        // Nothing allocates, so the functions are usable in constant expressions.
+        struct Lexer
+        {
+            // Consume front characters while the pred is true.
+            template <class It, class Pred>
+            static constexpr void forward(It& b, It e, Pred p)
+            {
+                while (b != e && p(*b))
+                {
+                    ++b;
+                }
+            }
+
+            // Consume back characters while the pred is true.
+            template <class It, class Pred>
+            static constexpr void backward(It b, It& e, Pred p)
+            {
+                while (b != e && p(*(e - 1)))
+                {
+                    --e;
+                }
+            }
+
+            // Consume front whitespaces
+            template <class It>
+            static constexpr void consumeWhitespace(It& b, It e)
+            {
+                forward(b, e, [](char c) { return c == ' ' || c == '\t'; });
+            }
+
+            template <class It>
+            static constexpr integer_t read_integer(It& it, It end)
+            {
+                const auto negative = *it == '-';
+                if (*it == '+' || *it == '-')
+                {
+                    ++it; // Skip '+' or '-'
+                }
+
+                // Accumulate negatively, so the minimum is representable.
+                constexpr auto min = (std::numeric_limits<integer_t>::min)();
+                integer_t i = 0;
+                for (; it != end && '0' <= *it && *it <= '9'; ++it)
+                {
+                    const auto d = static_cast<integer_t>(*it - '0');
+                    if (i < (min + d) / 10)
+                    {
+                        throw ParseException("Integer out of range.");
+                    }
+                    i = i * 10 - d;
+                }
+
+                if (!negative)
+                {
+                    if (i == min)
+                    {
+                        throw ParseException("Integer out of range.");
+                    }
+                    i = -i;
+                }
+                return i;
+            }
+
+            template <class It>
+            static constexpr bool isInteger(It it, It end)
+            {
+                if (*it == '+' || *it == '-')
+                {
+                    ++it; // Skip '+' or '-'
+                }
+                if (it == end)
+                {
+                    return false;
+                }
+                if (*it == '0')
+                {
+                    return false;
+                }
+
+                const It b = it;
+                forward(it, end, [](char c) { return '0' <= c && c <= '9'; });
+                if (it != end && *it == '.') // This is a real.
+                {
+                    return false;
+                }
+                return it != b;
+            }
+
+            template <class It>
+            static constexpr bool isReal(It it, It end)
+            {
+                if (*it == '+' || *it == '-')
+                {
+                    ++it; // Skip '+' or '-'
+                }
+                if (it == end)
+                {
+                    return false;
+                }
+
+                const It b = it;
+                forward(it, end, [](char c) { return '0' <= c && c <= '9'; });
+                if (it == end || *it != '.')
+                {
+                    return false;
+                }
+                ++it; // Skip '.'
+                forward(it, end, [](char c) { return '0' <= c && c <= '9'; });
+
+                return it - b != 1; // Not only "."
+            }
+
+            template <class It>
+            static constexpr bool isString(It it, It end)
+            {
+                if (*it != '\"')
+                {
+                    return false;
+                }
+                ++it; // Skip '\"'
+                forward(it, end, [](char c) { return c != '\"'; });
+                return it != end;
+            }
+
+            template <class It>
+            static constexpr bool isArray(It it, It end)
+            {
+                if (*it != '[')
+                {
+                    return false;
+                }
+
+                ++it; // Skip '['
+                size_t level = 1;
+                forward(it, end, [&](char c) {
+                    if (c == '[')
+                    {
+                        ++level;
+                    }
+                    else if (c == ']')
+                    {
+                        --level;
+                    }
+                    return level > 0;
+                });
+
+                return it != end && *it == ']';
+            }
+        };
+    }
+
+    // Parser
+    struct Parser : detail::Lexer
+    {
+        ParseOptions options_;
+
+        // Keys already seen in this document
+        std::unordered_map<std::string_view, Key> keys_;
+
+        Parser() = default;
+
+        explicit Parser(std::shared_ptr<KeyPool> pool)
+        {
+            options_.keys = std::move(pool);
+        }
+
+        explicit Parser(const ParseOptions& options)
+            : options_(options)
+        {
+        }
+
+        // Return the interned key of the characters.
+        // Repeated keys are looked up without allocation.
+        template <class It>
+        Key intern(It b, It e)
+        {
+            const auto str = b == e ? std::string_view() : std::string_view(&*b, static_cast<size_t>(e - b));
+
+            const auto found = keys_.find(str);
+            if (found != std::cend(keys_))
+            {
+                return found->second;
+            }
+
+            const auto key = options_.keys ? options_.keys->intern(str) : Key(str);
+            keys_.emplace(key.str(), key);
+            return key;
+        }
+
+        // <key> = <value>
+        template <class It>
+        void parse_key_eq_value(It& it, It end, table_t* table)
+        {
+            consumeWhitespace(it, end);
+            const auto key = parse_key(it, end, table);
+
+            ++it; // Skip '='.
+            consumeWhitespace(it, end);
+            const auto val = parse_value(it, end);
+
+            table->addValue(key, val);
+        }
+
+        template <class It>
+        Key parse_key(It& it, It end, table_t* table)
+        {
+            const It keyB = it;
+            forward(it, end, [](char c) { return c != ' ' && c != '\t' && c != '='; });
+            const It keyE = it;
+            if (it == end)
+            {
+                throw ParseException("Unexpected EOL.");
+            }
+
+            forward(it, end, [](char c) { return c != '='; });
+            if (it == end)
+            {
+                throw ParseException("Unexpected EOL.");
+            }
+
+            // The shape predicts the key, then it can not be duplicated.
+            const auto next = table->nextKey();
+            if (next && std::equal(keyB, keyE, std::cbegin(next->str()), std::cend(next->str())))
+            {
+                return *next;
+            }
+
+            const auto key = intern(keyB, keyE);
+            if (table->contains(key))
+            {
+                throw ParseException("Key duplicated (" + key.str() + ")");
+            }
+
+            return key;
+        }
+
+        template <class It>
+        std::shared_ptr<Value> parse_value(It& it, It end)
+        {
+            if (it == end)
+            {
+                throw ParseException("Unexpected EOL.");
+            }
+
+            if (isInteger(it, end))
+            {
+                return parse_integer(it, end);
+            }
+            else if (isReal(it, end))
+            {
+                return parse_real(it, end);
+            }
+            else if (isString(it, end))
+            {
+                return parse_string(it, end);
+            }
+            else if (isArray(it, end))
+            {
+                return parse_array(it, end);
+            }
+
+            throw ParseException("Unexpected right value.");
+        }
+
+        template <class It>
+        std::shared_ptr<Integer> parse_integer(It& it, It end)
+        {
+            return std::make_shared<Integer>(read_integer(it, end));
+        }
+
+        template <class It>
+        std::shared_ptr<Real> parse_real(It& it, It end)
+        {
+            return std::make_shared<Real>(read_real(it, end));
+        }
+
+        template <class It>
+        real_t read_real(It& it, It end)
+        {
+            int sign = 1;
+            if (*it == '+' || *it == '-')
+            {
+                sign = *it == '+' ? 1 : -1;
+                ++it; // Skip '+' or '-'
+            }
+
+            const It b = it;
+            forward(it, end, [](char c) { return '0' <= c && c <= '9'; });
+            ++it; // Skip '.'
+            forward(it, end, [](char c) { return '0' <= c && c <= '9'; });
+            const It e = it;
+
+#ifdef SML_DOUBLE
+            auto r = std::stod(std::string(b, e));
+#else
+            auto r = std::stof(std::string(b, e));
+#endif
+
+            r *= sign;
+
+            return r;
+        }
+
+        template <class It>
+        std::shared_ptr<String> parse_string(It& it, It end)
+        {
+            return std::make_shared<String>(read_string(it, end));
+        }
+
+        template <class It>
+        std::string read_string(It& it, It end)
+        {
+            ++it; // Skip '\"'
+
+            const It b = it;
+            forward(it, end, [](char c) { return c != '\"'; });
+            const It e = it;
+            ++it; // Skip '\"'
+
+            return std::string(b, e);
+        }
+
+        template <class It>
+        std::shared_ptr<array_t> parse_array(It& it, It end)
+        {
+            It tmp = it;
+            ++tmp;
+            consumeWhitespace(tmp, end);
+
+            if (isInteger(tmp, end))
+            {
+                return parse_array(it, end, [&](It& i, It e) { return read_integer(i, e); });
+            }
+            else if (isReal(tmp, end))
+            {
+                return parse_array(it, end, [&](It& i, It e) { return read_real(i, e); });
+            }
+            else if (isString(tmp, end))
+            {
+                return parse_array(it, end, [&](It& i, It e) { return read_string(i, e); });
+            }
+            else if (isArray(tmp, end))
+            {
+                const auto arr = parse_array(it, end, [&](It& i, It e) { return parse_array(i, e); });
+                arr->pack();
+                return arr;
+            }
+
+            throw ParseException("Invalid array format.");
+        }
+
+        template <class It, class ElemParser>
+        std::shared_ptr<array_t> parse_array(It& it, It end, ElemParser efun)
+        {
+            const auto arr = std::make_shared<array_t>();
+
+            while (*it != ']')
+            {
+                ++it; // Skip '[' or ','
+                consumeWhitespace(it, end);
+
+                arr->insertBack(efun(it, end));
+
+                consumeWhitespace(it, end);
+            }
+            ++it; // Skip ']'
+
+            return arr;
+        }
+
+        // [<table key>]
+        template <class It>
+        table_t* parse_table(It& it, It end, table_t* root)
+        {
+            consumeWhitespace(it, end);
+            if (it == end)
+            {
+                throw ParseException("Unexpected EOL.");
+            }
+
+            const auto isTableArray = *it == '+';
+            if (isTableArray)
+            {
+                ++it;
+            }
+
+            if (*it != '[')
+            {
+                throw ParseException("Unexpected character \'" + *it + std::string("\'."));
+            }
+
+            // Parse table path
+            std::queue<std::string> path;
+
+            while (*it != ']')
+            {
+                ++it; // Skip '[' or '.'.
+                consumeWhitespace(it, end);
+
+                const It keyB = it;
+                forward(it, end, [](char c) { return c != ' ' && c != '\t' && c != '.' && c != ']'; });
+                const It keyE = it;
+                if (it == end)
+                {
+                    throw ParseException("Unexpected EOL.");
+                }
+
+                const std::string key(keyB, keyE);
+                if (key.empty())
+                {
+                    throw ParseException("Unexpected character \'" + *it + std::string("\'."));
+                }
+
+                path.push(key);
+
+                if (*it == ' ' || *it == '\t')
+                {
+                    forward(it, end, [](char c) { return c != '.' && c != ']'; });
+                    if (it == end)
+                    {
+                        throw ParseException("Unexpected EOL.");
+                    }
+                }
+            }
+
+            ++it; // Skip ']'.
+
+            // Create new table from path
+            std::string fullpath;
+            table_t* cur = root;
+            while (path.size() > 1)
+            {
+                const auto key = path.front();
+                path.pop();
+
+                if (!fullpath.empty())
+                {
+                    fullpath += ".";
+                }
+                fullpath += key;
+
+                if (valueIs<array_t>(key, *cur))
+                {
+                    auto& arr = cur->template valueAs<array_t>(key);
+                    if (!arrayIs<table_t>(arr))
+                    {
+                        throw ParseException("Key is not defined (" + fullpath + ").");
+                    }
+                    cur = &(arr.template valueAs<table_t>(arr.length() - 1));
+                }
+                else if (valueIs<table_t>(key, *cur))
+                {
+                    cur = &(cur->template valueAs<table_t>(key));
+                }
+                else
+                {
+                    throw ParseException("Key is not defined (" + fullpath + ").");
+                }
+            }
+
+            const auto key = path.front();
+            const auto newTable = std::make_shared<table_t>();
+
+            if (!fullpath.empty())
+            {
+                fullpath += ".";
+            }
+            fullpath += key;
+
+            if (isTableArray)
+            {
+                if (!cur->contains(key))
+                {
+                    const auto arr = std::make_shared<array_t>();
+                    cur->addValue(intern(std::cbegin(key), std::cend(key)), arr);
+                    arr->insertBack(newTable);
+                }
+                else
+                {
+                    if (!valueIs<array_t>(key, *cur))
+                    {
+                        throw ParseException("Key is not defined (" + fullpath + ").");
+                    }
+
+                    auto& arr = cur->template valueAs<array_t>(key);
+                    if (!arrayIs<table_t>(arr))
+                    {
+                        throw ParseException("Key is not defined (" + fullpath + ").");
+                    }
+
+                    // Elements usually have the same keys as the previous one.
+                    newTable->adoptShape(arr.template valueAs<table_t>(arr.length() - 1));
+                    arr.insertBack(newTable);
+                }
+            }
+            else
+            {
+                if (cur->contains(key))
+                {
+                    throw ParseException("Key duplicated (" + fullpath + ")");
+                }
+                cur->addValue(intern(std::cbegin(key), std::cend(key)), newTable);
+            }
+
+            return newTable.get();
+        }
+
+        // Parse one line into the document.
+        // 'current' is the table which following keys go into.
+        template <class It>
+        void parse_line(It it, It end, table_t* root, table_t*& current)
+        {
+            // Erase front whitespaces.
+            consumeWhitespace(it, end);
+
+            if (it == end || *it == '#')
+            {
+                return;
+            }
+
+            if (*it == '[' || *it == '+')
+            {
+                // (+)[<table key>]
+                // Create new table
+                current = parse_table(it, end, root);
+            }
+            else
+            {
+                // <key> = <value>
+                // Parse pair of key and value
+                parse_key_eq_value(it, end, current);
+            }
+
+            // After that the parse, the line need to be empty
+            consumeWhitespace(it, end);
+            if (it != end && *it != '#')
+            {
+                throw ParseException(std::string("Unexpected character \'" + *it + std::string("\'.")));
+            }
+        }
+
+        std::shared_ptr<const table_t> parse(const std::string& path)
+        {
+            std::ifstream in;
+
+            in.open(path);
+            if (!in.is_open())
+            {
+                throw ParseException("Failed to open file (" + path + ")");
+            }
+
+            struct Closer
+            {
+                std::ifstream* in;
+                ~Closer()
+                {
+                    in->close();
+                }
+            };
+            Closer closer{ &in };
+
+            const auto rootTable = std::make_shared<table_t>();
+            table_t* currentTable = rootTable.get();
+
+            std::string line;
+            while (!in.eof())
+            {
+                std::getline(in, line);
+                parse_line(std::cbegin(line), std::cend(line), rootTable.get(), currentTable);
+            }
+
+            finish(*rootTable);
+            return rootTable;
+        }
+
+        /// Parse the text of a whole .sml file. Lines may end with "\r\n".
+        std::shared_ptr<const table_t> parseText(std::string_view text)
+        {
+            const auto rootTable = std::make_shared<table_t>();
+            table_t* currentTable = rootTable.get();
+
+            size_t pos = 0;
+            while (pos <= text.size())
+            {
+                auto eol = text.find('\n', pos);
+                eol = eol == std::string_view::npos ? text.size() : eol;
+                auto line = text.substr(pos, eol - pos);
+                if (!line.empty() && line.back() == '\r')
+                {
+                    line.remove_suffix(1);
+                }
+                parse_line(std::cbegin(line), std::cend(line), rootTable.get(), currentTable);
+                pos = eol + 1;
+            }
+
+            finish(*rootTable);
+            return rootTable;
+        }
+
+        void finish(table_t& root)
+        {
+            if (options_.dedup)
+            {
+                const auto stats = dedup(root);
+                if (options_.dedupStats)
+                {
+                    *options_.dedupStats = stats;
+                }
+            }
+        }
+    };
+
+    using ParseResult = table_t;
+
+    /// Parse a .sml file
+    inline std::shared_ptr<const ParseResult> parse(const std::string& path)
+    {
+        return Parser().parse(path);
+    }
+
+    /// Parse a .sml file, sharing keys with other documents parsed with the pool.
+    inline std::shared_ptr<const ParseResult> parse(const std::string& path, const std::shared_ptr<KeyPool>& pool)
+    {
+        return Parser(pool).parse(path);
+    }
+
+    /// ditto
+    inline std::shared_ptr<const ParseResult> parse(const std::string& path, const ParseOptions& options)
+    {
+        return Parser(options).parse(path);
+    }
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef SML_SMLRECLAIM_H
+#define SML_SMLRECLAIM_H
+
+#include "smldef.h"
+#include "smlobj.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace sml
+{
+    /// Time spent by a Reclaimer.
+    struct ReclaimStats
+    {
+        size_t documents = 0; // Count of retired documents
+        std::chrono::nanoseconds total = std::chrono::nanoseconds(0);
+        std::chrono::nanoseconds max = std::chrono::nanoseconds(0);
+    };
+
+    /// Thread which destroys documents handed to it.
+    /// Dropping the last reference of a large document can take long, adopt() moves that
+    /// work off whichever thread happens to drop it. The reclaimer must outlive adopted documents.
+    class Reclaimer
+    {
+    private:
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable idle_;
+        std::deque<std::shared_ptr<const table_t>> queue_;
+        bool busy_ = false;
+        bool stop_ = false;
+        ReclaimStats stats_;
+        std::thread thread_;
+
+    public:
+        Reclaimer()
+            : thread_([this] { run(); })
+        {
+        }
+
+        Reclaimer(const Reclaimer&) = delete;
+        Reclaimer& operator=(const Reclaimer&) = delete;
+
+        /// Destroy the remaining documents and stop the thread.
+        ~Reclaimer()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            wake_.notify_one();
+            thread_.join();
+        }
+
+        /// Return a reference to the document whose release hands it to this reclaimer.
+        std::shared_ptr<const table_t> adopt(std::shared_ptr<const table_t> doc)
+        {
+            const auto p = doc.get();
+            return std::shared_ptr<const table_t>(p, [this, doc = std::move(doc)](const table_t*) mutable {
+                retire(std::move(doc));
+            });
+        }
+
+        /// Drop the reference on the reclaimer thread. The document is destroyed there
+        /// unless other references remain, which keep it alive as usual.
+        void retire(std::shared_ptr<const table_t> doc)
+        {
+            if (!doc)
+            {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queue_.emplace_back(std::move(doc));
+            }
+            wake_.notify_one();
+        }
+
+        /// Wait until all documents handed so far are destroyed.
+        void flush()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            idle_.wait(lock, [this] { return queue_.empty() && !busy_; });
+        }
+
+        ReclaimStats stats()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return stats_;
+        }
+
+    private:
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (;;)
+            {
+                wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (queue_.empty())
+                {
+                    return;
+                }
+
+                auto doc = std::move(queue_.front());
+                queue_.pop_front();
+                busy_ = true;
+                lock.unlock();
+
+                const auto begin = std::chrono::steady_clock::now();
+                doc.reset();
+                const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+
+                lock.lock();
+                busy_ = false;
+                ++stats_.documents;
+                stats_.total += elapsed;
+                stats_.max = (std::max)(stats_.max, elapsed);
+                if (queue_.empty())
+                {
+                    idle_.notify_all();
+                }
+            }
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,364 @@
+#ifndef SML_SMLRELOAD_H
+#define SML_SMLRELOAD_H
+
+#include "smldef.h"
+#include "smlobj.h"
+#include "smlparse.h"
+#include "smlreclaim.h"
+#include "smltransaction.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace sml
+{
+    /// Owner of the current snapshot of a .sml file, reparsed when the file changes.
+    /// A new snapshot is published atomically. Readers holding an old snapshot keep it
+    /// alive until they take the next one, so readers never block.
+    class ConfigHandle
+    {
+    public:
+        using Snapshot = std::shared_ptr<const table_t>;
+
+        /// Called on the watcher thread after a new snapshot is published.
+        using Listener = std::function<void(const Snapshot& before, const Snapshot& after)>;
+
+        /// Cache of the snapshot for one thread.
+        /// Reading costs one atomic load of the generation while nothing is published,
+        /// the snapshot is taken with a refcount only when the generation changes.
+        class Reader
+        {
+        private:
+            const ConfigHandle* handle_;
+            uint64_t generation_ = 0;
+            Snapshot snapshot_;
+
+        public:
+            explicit Reader(const ConfigHandle& handle)
+                : handle_(&handle)
+            {
+            }
+
+            /// Return the latest snapshot. Valid until the next call of get() on this reader.
+            const table_t& get()
+            {
+                const auto generation = handle_->generation();
+                if (generation != generation_)
+                {
+                    snapshot_ = handle_->snapshot();
+                    generation_ = generation;
+                }
+                return *snapshot_;
+            }
+
+            const table_t& operator*()
+            {
+                return get();
+            }
+
+            const table_t* operator->()
+            {
+                return &get();
+            }
+        };
+
+    private:
+        std::string path_;
+        ParseOptions options_;
+
+#ifdef __cpp_lib_atomic_shared_ptr
+        std::atomic<Snapshot> current_;
+#else
+        Snapshot current_;
+#endif
+        std::atomic<uint64_t> generation_{ 0 };
+        std::mutex publishMutex_;
+        std::atomic<Reclaimer*> reclaimer_{ nullptr };
+
+        std::thread watcher_;
+        std::atomic<bool> stop_{ false };
+        mutable std::mutex errorMutex_;
+        std::string lastError_;
+
+    public:
+        /// Parse the file. Throw ParseException if failed.
+        explicit ConfigHandle(std::string path, const ParseOptions& options = ParseOptions())
+            : path_(std::move(path))
+            , options_(options)
+        {
+            publish(sml::parse(path_, options_));
+        }
+
+        ConfigHandle(const ConfigHandle&) = delete;
+        ConfigHandle& operator=(const ConfigHandle&) = delete;
+
+        ~ConfigHandle()
+        {
+            unwatch();
+        }
+
+        /// Return the current snapshot.
+        Snapshot snapshot() const
+        {
+#ifdef __cpp_lib_atomic_shared_ptr
+            return current_.load();
+#else
+            return std::atomic_load(&current_);
+#endif
+        }
+
+        /// Count of published snapshots.
+        uint64_t generation() const
+        {
+            return generation_.load(std::memory_order_acquire);
+        }
+
+        /// Destroy snapshots published after this on the reclaimer thread,
+        /// instead of on the thread which drops the last reference. Null to stop.
+        void setReclaimer(Reclaimer* reclaimer)
+        {
+            reclaimer_ = reclaimer;
+        }
+
+        /// Make the document the current snapshot.
+        void publish(Snapshot doc)
+        {
+            if (const auto reclaimer = reclaimer_.load())
+            {
+                doc = reclaimer->adopt(std::move(doc));
+            }
+
+            std::lock_guard<std::mutex> lock(publishMutex_);
+            store(std::move(doc));
+        }
+
+        /// Publish the transaction if the current snapshot is still its base.
+        /// Return false if another snapshot was published after the transaction began.
+        bool commit(Transaction& txn)
+        {
+            std::lock_guard<std::mutex> lock(publishMutex_);
+            if (snapshot() != txn.base())
+            {
+                return false;
+            }
+
+            auto doc = txn.commit();
+            if (const auto reclaimer = reclaimer_.load())
+            {
+                doc = reclaimer->adopt(std::move(doc));
+            }
+            store(std::move(doc));
+            return true;
+        }
+
+        /// Apply the updates to the current snapshot and publish it,
+        /// retrying on a newer snapshot until committed. The function is called as f(Transaction&).
+        template <class F>
+        void update(F f)
+        {
+            for (;;)
+            {
+                Transaction txn(snapshot());
+                f(txn);
+                if (commit(txn))
+                {
+                    return;
+                }
+            }
+        }
+
+        /// Reparse the file now and publish it if its contents changed.
+        /// The file is compared again if another snapshot is published meanwhile,
+        /// so 'before' given to the listener is the snapshot replaced.
+        /// Return true if published. Throw ParseException if failed.
+        bool reload(const Listener& listener = Listener())
+        {
+            Snapshot next = sml::parse(path_, options_);
+            for (;;)
+            {
+                const auto before = snapshot();
+                if (next->hash() == before->hash() && equal(*next, *before))
+                {
+                    return false;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(publishMutex_);
+                    if (snapshot() != before)
+                    {
+                        continue;
+                    }
+                    if (const auto reclaimer = reclaimer_.load())
+                    {
+                        next = reclaimer->adopt(std::move(next));
+                    }
+                    store(next);
+                }
+
+                if (listener)
+                {
+                    listener(before, next);
+                }
+                return true;
+            }
+        }
+
+        /// Start a thread which reloads the file when it changes.
+        /// Changes are watched by inotify on Linux and by polling the modified time elsewhere.
+        /// Failures of parsing are kept in lastError() and the current snapshot is kept.
+        void watch(std::chrono::milliseconds interval = std::chrono::milliseconds(500), Listener listener = Listener())
+        {
+            unwatch();
+            stop_ = false;
+
+            // Start watching before returning, so no change after this is missed.
+#ifdef __linux__
+            const auto fd = openNotify();
+            if (fd >= 0)
+            {
+                watcher_ = std::thread([this, fd, interval, listener] { watchNotify(fd, interval, listener); });
+                return;
+            }
+#endif
+            std::error_code ec;
+            const auto last = std::filesystem::last_write_time(path_, ec);
+            watcher_ = std::thread([this, last, interval, listener] { watchPoll(last, interval, listener); });
+        }
+
+        /// Stop watching. Wait for the watcher thread to end.
+        void unwatch()
+        {
+            if (watcher_.joinable())
+            {
+                stop_ = true;
+                watcher_.join();
+            }
+        }
+
+        /// Message of the last failure on the watcher thread, or empty.
+        std::string lastError() const
+        {
+            std::lock_guard<std::mutex> lock(errorMutex_);
+            return lastError_;
+        }
+
+        const std::string& path() const
+        {
+            return path_;
+        }
+
+    private:
+        /// Replace the current snapshot. Called with publishMutex_ held.
+        void store(Snapshot doc)
+        {
+#ifdef __cpp_lib_atomic_shared_ptr
+            current_.store(std::move(doc));
+#else
+            std::atomic_store(&current_, std::move(doc));
+#endif
+            generation_.fetch_add(1, std::memory_order_release);
+        }
+
+        void tryReload(const Listener& listener)
+        {
+            try
+            {
+                reload(listener);
+                std::lock_guard<std::mutex> lock(errorMutex_);
+                lastError_.clear();
+            }
+            catch (const std::exception& e)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex_);
+                lastError_ = e.what();
+            }
+        }
+
+        void watchPoll(std::filesystem::file_time_type last, std::chrono::milliseconds interval, const Listener& listener)
+        {
+            std::error_code ec;
+            while (!stop_)
+            {
+                std::this_thread::sleep_for(interval);
+                const auto now = std::filesystem::last_write_time(path_, ec);
+                if (!ec && now != last)
+                {
+                    last = now;
+                    tryReload(listener);
+                }
+            }
+        }
+
+#ifdef __linux__
+        /// Return the inotify descriptor watching the file, or -1 if not available.
+        int openNotify() const
+        {
+            const auto fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (fd < 0)
+            {
+                return -1;
+            }
+
+            // Watch the directory, editors often replace the file by renaming.
+            const std::filesystem::path file(path_);
+            const auto dir = file.has_parent_path() ? file.parent_path() : std::filesystem::path(".");
+            if (inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+            {
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+
+        void watchNotify(int fd, std::chrono::milliseconds interval, const Listener& listener)
+        {
+            const auto name = std::filesystem::path(path_).filename().string();
+
+            alignas(inotify_event) char buf[4096];
+            while (!stop_)
+            {
+                pollfd p{ fd, POLLIN, 0 };
+                if (poll(&p, 1, static_cast<int>(interval.count())) <= 0)
+                {
+                    continue;
+                }
+
+                auto changed = false;
+                ssize_t n;
+                while ((n = read(fd, buf, sizeof(buf))) > 0)
+                {
+                    for (ssize_t i = 0; i < n;)
+                    {
+                        const auto e = reinterpret_cast<const inotify_event*>(buf + i);
+                        changed = changed || (e->len > 0 && name == e->name);
+                        i += sizeof(inotify_event) + e->len;
+                    }
+                }
+                if (changed)
+                {
+                    tryReload(listener);
+                }
+            }
+
+            close(fd);
+        }
+#endif
+    };
+}
+
+#endif
@@ -0,0 +1,366 @@
+#ifndef SML_SMLSHARED_H
+#define SML_SMLSHARED_H
+
+// Not included by sml.h, as it includes the platform headers through smlmmap.h.
+
+#include "smldef.h"
+#include "smlfrozen.h"
+#include "smlmmap.h"
+#include "smlobj.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace sml
+{
+    namespace shared
+    {
+        constexpr uint32_t Magic = 0x43534d53; // "SMSC"
+
+        /// Beginning of the control segment.
+        /// The document of a generation is in the segment named "<name>.<generation>".
+        struct Control
+        {
+            uint32_t magic;
+            frozen::Layout layout; // Of the published documents
+            std::atomic<uint64_t> generation;
+        };
+
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "generations are shared among processes");
+
+        inline std::string segmentName(const std::string& name, uint64_t generation)
+        {
+            return name + "." + std::to_string(generation);
+        }
+
+        /// Named shared memory mapped into this process.
+        class Segment
+        {
+        private:
+            unsigned char* data_ = nullptr;
+            size_t size_ = 0;
+            std::string name_;
+            bool owner_ = false;
+#ifdef _WIN32
+            HANDLE handle_ = nullptr;
+#endif
+
+        public:
+            Segment() = default;
+
+            Segment(const Segment&) = delete;
+            Segment& operator=(const Segment&) = delete;
+
+            ~Segment()
+            {
+#if defined(_WIN32)
+                if (data_)
+                {
+                    UnmapViewOfFile(data_);
+                }
+                if (handle_)
+                {
+                    CloseHandle(handle_);
+                }
+#elif defined(SML_HAS_MMAP)
+                if (data_)
+                {
+                    munmap(data_, size_);
+                    if (owner_)
+                    {
+                        shm_unlink(name_.c_str());
+                    }
+                }
+#endif
+            }
+
+            /// Make a new segment of the size, writable. Throw std::runtime_error if failed or already exists.
+            static std::unique_ptr<Segment> create(const std::string& name, size_t size)
+            {
+                auto s = std::unique_ptr<Segment>(new Segment());
+                s->name_ = name;
+                s->size_ = size;
+                s->owner_ = true;
+#if defined(_WIN32)
+                s->handle_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                                static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), name.c_str());
+                if (!s->handle_ || GetLastError() == ERROR_ALREADY_EXISTS)
+                {
+                    throw std::runtime_error("Failed to create shared memory (" + name + ")");
+                }
+                s->data_ = static_cast<unsigned char*>(MapViewOfFile(s->handle_, FILE_MAP_WRITE, 0, 0, size));
+                if (!s->data_)
+                {
+                    throw std::runtime_error("Failed to map shared memory (" + name + ")");
+                }
+#elif defined(SML_HAS_MMAP)
+                const auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+                if (fd < 0)
+                {
+                    throw std::runtime_error("Failed to create shared memory (" + name + ")");
+                }
+                void* p = MAP_FAILED;
+                if (ftruncate(fd, static_cast<off_t>(size)) == 0)
+                {
+                    p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                }
+                close(fd);
+                if (p == MAP_FAILED)
+                {
+                    shm_unlink(name.c_str());
+                    throw std::runtime_error("Failed to map shared memory (" + name + ")");
+                }
+                s->data_ = static_cast<unsigned char*>(p);
+#else
+                throw std::runtime_error("Shared memory is not supported");
+#endif
+                return s;
+            }
+
+            /// Map an existing segment. Return nullptr if not exists.
+            static std::unique_ptr<Segment> open(const std::string& name, bool writable)
+            {
+                auto s = std::unique_ptr<Segment>(new Segment());
+                s->name_ = name;
+#if defined(_WIN32)
+                s->handle_ = OpenFileMappingA(writable ? FILE_MAP_WRITE : FILE_MAP_READ, FALSE, name.c_str());
+                if (!s->handle_)
+                {
+                    return nullptr;
+                }
+                s->data_ = static_cast<unsigned char*>(MapViewOfFile(s->handle_, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+                MEMORY_BASIC_INFORMATION info;
+                if (!s->data_ || !VirtualQuery(s->data_, &info, sizeof(info)))
+                {
+                    throw std::runtime_error("Failed to map shared memory (" + name + ")");
+                }
+                s->size_ = info.RegionSize;
+#elif defined(SML_HAS_MMAP)
+                const auto fd = shm_open(name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+                if (fd < 0)
+                {
+                    return nullptr;
+                }
+                struct stat st;
+                if (fstat(fd, &st) != 0 || st.st_size == 0)
+                {
+                    close(fd);
+                    throw std::runtime_error("Failed to map shared memory (" + name + ")");
+                }
+                s->size_ = static_cast<size_t>(st.st_size);
+                const auto p = mmap(nullptr, s->size_, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+                close(fd);
+                if (p == MAP_FAILED)
+                {
+                    throw std::runtime_error("Failed to map shared memory (" + name + ")");
+                }
+                s->data_ = static_cast<unsigned char*>(p);
+#else
+                (void)writable;
+                throw std::runtime_error("Shared memory is not supported");
+#endif
+                return s;
+            }
+
+            unsigned char* data() const
+            {
+                return data_;
+            }
+
+            size_t size() const
+            {
+                return size_;
+            }
+
+            /// Remove the name of a segment. Processes mapping it keep it alive.
+            /// Names on Windows are removed with their last handle, so this does nothing.
+            static void remove(const std::string& name)
+            {
+#if !defined(_WIN32) && defined(SML_HAS_MMAP)
+                shm_unlink(name.c_str());
+#else
+                (void)name;
+#endif
+            }
+        };
+    }
+
+    /// Publisher of frozen documents to other processes by shared memory.
+    /// Each document is copied once into its own segment. Processes attached by SharedDocument
+    /// read it in place and move to a newer generation without copying.
+    /// A name is of the form "/name" on POSIX and "Local\\name" or "Global\\name" on Windows.
+    class SharedPublisher
+    {
+    private:
+        std::string name_;
+        std::unique_ptr<shared::Segment> control_;
+        std::unique_ptr<shared::Segment> current_;
+
+    public:
+        /// Make the control segment. Throw std::runtime_error if it already exists,
+        /// such as left by a publisher which crashed. remove() clears such names.
+        explicit SharedPublisher(std::string name)
+            : name_(std::move(name))
+            , control_(shared::Segment::create(name_, sizeof(shared::Control)))
+        {
+            const auto control = new (control_->data()) shared::Control();
+            control->magic = shared::Magic;
+            control->layout = frozen::currentLayout();
+            control->generation.store(0, std::memory_order_release);
+        }
+
+        SharedPublisher(const SharedPublisher&) = delete;
+        SharedPublisher& operator=(const SharedPublisher&) = delete;
+
+        /// Remove the names. Attached processes keep reading what they mapped.
+        ~SharedPublisher() = default;
+
+        /// Remove the control segment and the segments of generations up to 'generations'
+        /// left by a publisher which crashed.
+        static void remove(const std::string& name, uint64_t generations = 0)
+        {
+            shared::Segment::remove(name);
+            for (uint64_t i = 1; i <= generations; ++i)
+            {
+                shared::Segment::remove(shared::segmentName(name, i));
+            }
+        }
+
+        /// Count of published documents.
+        uint64_t generation() const
+        {
+            return control()->generation.load(std::memory_order_acquire);
+        }
+
+        /// Copy the document into a new segment and make it the current generation.
+        /// The segment of the previous generation is unnamed, processes mapping it keep it alive.
+        /// Return the new generation.
+        uint64_t publish(const FrozenDocument& doc)
+        {
+            const auto size = frozen::at<frozen::Header>(doc.data(), 0)->size;
+            const auto next = generation() + 1;
+
+            // The name is owned by this publisher, it may be left by a previous one
+            shared::Segment::remove(shared::segmentName(name_, next));
+            auto segment = shared::Segment::create(shared::segmentName(name_, next), size);
+            std::memcpy(segment->data(), doc.data(), size);
+
+            control()->generation.store(next, std::memory_order_release);
+            current_ = std::move(segment);
+            return next;
+        }
+
+        /// ditto
+        uint64_t publish(const table_t& doc, const FreezeOptions& options = FreezeOptions())
+        {
+            return publish(freeze(doc, options));
+        }
+
+        const std::string& name() const
+        {
+            return name_;
+        }
+
+    private:
+        shared::Control* control() const
+        {
+            return reinterpret_cast<shared::Control*>(control_->data());
+        }
+    };
+
+    /// Document published by a SharedPublisher of another process, read in place.
+    /// The mapped document stays valid until refresh() moves to a newer one.
+    class SharedDocument
+    {
+    private:
+        std::string name_;
+        std::unique_ptr<shared::Segment> control_;
+        uint64_t generation_ = 0;
+        FrozenDocument doc_;
+
+    public:
+        /// Attach to the current generation.
+        /// Throw std::runtime_error if nothing is published by the name,
+        /// ParseException if the publisher is a build of another layout.
+        explicit SharedDocument(std::string name)
+            : name_(std::move(name))
+            , control_(shared::Segment::open(name_, false))
+        {
+            if (!control_ || control_->size() < sizeof(shared::Control) || control()->magic != shared::Magic)
+            {
+                throw std::runtime_error("No shared document (" + name_ + ")");
+            }
+            frozen::checkLayout(control()->layout);
+            if (!refresh())
+            {
+                throw std::runtime_error("No shared document (" + name_ + ")");
+            }
+        }
+
+        /// Generation of the attached document.
+        uint64_t generation() const
+        {
+            return generation_;
+        }
+
+        /// Whether a newer generation is published. Costs one atomic load.
+        bool changed() const
+        {
+            return control()->generation.load(std::memory_order_acquire) != generation_;
+        }
+
+        /// Attach to the newest generation if changed. Return true if attached to a new one.
+        bool refresh()
+        {
+            for (;;)
+            {
+                const auto generation = control()->generation.load(std::memory_order_acquire);
+                if (generation == generation_)
+                {
+                    return false;
+                }
+
+                std::shared_ptr<shared::Segment> segment = shared::Segment::open(shared::segmentName(name_, generation), false);
+                if (!segment)
+                {
+                    // Replaced after loading the generation, or the publisher is gone
+                    if (control()->generation.load(std::memory_order_acquire) == generation)
+                    {
+                        throw std::runtime_error("No shared document (" + shared::segmentName(name_, generation) + ")");
+                    }
+                    continue;
+                }
+
+                const auto data = segment->data();
+                doc_ = FrozenDocument(std::shared_ptr<const unsigned char>(segment, data), segment->size());
+                generation_ = generation;
+                return true;
+            }
+        }
+
+        /// Return the attached document.
+        const FrozenDocument& document() const
+        {
+            return doc_;
+        }
+
+        /// Return the root table of the attached document.
+        FrozenTable root() const
+        {
+            return doc_.root();
+        }
+
+    private:
+        shared::Control* control() const
+        {
+            return reinterpret_cast<shared::Control*>(control_->data());
+        }
+    };
+}
+
+#endif
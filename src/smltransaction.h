@@ -0,0 +1,274 @@
+#ifndef SML_SMLTRANSACTION_H
+#define SML_SMLTRANSACTION_H
+
+#include "smldef.h"
+#include "smlobj.h"
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace sml
+{
+    /// Batch of updates to a snapshot, committed as a new snapshot.
+    /// Only the tables and arrays on the paths to the updated values are copied,
+    /// all other subtrees and their cached hashes are shared with the base snapshot.
+    /// The base snapshot is never modified.
+    ///
+    /// A path joins keys by '.' and may index an array of tables by "[i]", such as "tarr[1].id".
+    class Transaction
+    {
+    private:
+        struct Segment
+        {
+            std::string key;
+            bool indexed = false;
+            size_t index = 0;
+        };
+
+        std::shared_ptr<const table_t> base_;
+        std::shared_ptr<table_t> root_;
+
+        // Nodes copied by this transaction, which may be modified
+        std::unordered_set<const Value*> owned_;
+
+    public:
+        /// Throw std::invalid_argument if the base is null.
+        explicit Transaction(std::shared_ptr<const table_t> base)
+            : base_(std::move(base))
+            , root_(copy(base_))
+        {
+        }
+
+        /// Return the snapshot this transaction began from.
+        const std::shared_ptr<const table_t>& base() const
+        {
+            return base_;
+        }
+
+        /// Map the value by the path, replacing the value if exists.
+        /// Missing tables on the way are made. Throw MismatchType if the way is not a table.
+        void set(const std::string& path, const std::shared_ptr<Value>& val)
+        {
+            const auto segments = split(path);
+            auto& table = spine(segments);
+            const auto& last = segments.back();
+            if (last.indexed)
+            {
+                own(table, last.key, false, TypeTag<array_t>()).setValue(last.index, val);
+            }
+            else
+            {
+                table.setValue(last.key, val);
+            }
+        }
+
+        /// Map the integer, real or string by the path.
+        template <class T, class = std::enable_if_t<!std::is_convertible<T, std::shared_ptr<Value>>::value>>
+        void set(const std::string& path, const T& val)
+        {
+            using Source = SourceType_t<T>;
+            set(path, std::make_shared<ObjectType_t<Source>>(static_cast<Source>(val)));
+        }
+
+        /// Remove the key of the path. Return false if not exists.
+        /// Elements of arrays can not be removed.
+        bool erase(const std::string& path)
+        {
+            checkOpen();
+            const auto segments = split(path);
+            if (segments.back().indexed)
+            {
+                throw MismatchType();
+            }
+            if (!exists(segments))
+            {
+                return false;
+            }
+            return spine(segments).removeValue(segments.back().key);
+        }
+
+        /// Finish the transaction and return the new snapshot.
+        std::shared_ptr<const table_t> commit()
+        {
+            checkOpen();
+            owned_.clear();
+            return std::move(root_);
+        }
+
+    private:
+        static std::shared_ptr<table_t> copy(const std::shared_ptr<const table_t>& base)
+        {
+            if (!base)
+            {
+                throw std::invalid_argument("Transaction base is null");
+            }
+            return std::make_shared<table_t>(*base);
+        }
+
+        /// Throw std::logic_error if committed.
+        void checkOpen() const
+        {
+            if (!root_)
+            {
+                throw std::logic_error("Transaction already committed");
+            }
+        }
+
+        static std::vector<Segment> split(const std::string& path)
+        {
+            std::vector<Segment> segments;
+            size_t b = 0;
+            for (;;)
+            {
+                const auto e = (std::min)(path.find('.', b), path.size());
+                Segment s;
+                s.key = path.substr(b, e - b);
+
+                const auto open = s.key.find('[');
+                if (open != std::string::npos)
+                {
+                    if (s.key.back() != ']')
+                    {
+                        throw ParseException("Invalid path (" + path + ").");
+                    }
+                    // One or more digits between '[' and ']'
+                    if (open + 2 == s.key.size())
+                    {
+                        throw ParseException("Invalid path (" + path + ").");
+                    }
+                    s.index = 0;
+                    for (size_t i = open + 1; i + 1 < s.key.size(); ++i)
+                    {
+                        const auto c = s.key[i];
+                        if (c < '0' || c > '9' || s.index > ((std::numeric_limits<size_t>::max)() - 9) / 10)
+                        {
+                            throw ParseException("Invalid path (" + path + ").");
+                        }
+                        s.index = s.index * 10 + static_cast<size_t>(c - '0');
+                    }
+                    s.indexed = true;
+                    s.key.resize(open);
+                }
+                if (s.key.empty())
+                {
+                    throw ParseException("Invalid path (" + path + ").");
+                }
+                segments.emplace_back(std::move(s));
+
+                if (e == path.size())
+                {
+                    return segments;
+                }
+                b = e + 1;
+            }
+        }
+
+        /// Whether all tables on the path exist, ignoring the last key.
+        bool exists(const std::vector<Segment>& segments) const
+        {
+            const table_t* table = root_.get();
+            for (size_t i = 0; i + 1 < segments.size(); ++i)
+            {
+                const auto& s = segments[i];
+                const auto val = table->find(s.key);
+                if (!val)
+                {
+                    return false;
+                }
+                if (s.indexed)
+                {
+                    if (!valueIs<array_t>(*val) || s.index >= static_cast<const array_t&>(*val).length())
+                    {
+                        return false;
+                    }
+                    table = &static_cast<const array_t&>(*val).valueAs<table_t>(s.index);
+                }
+                else
+                {
+                    if (!valueIs<table_t>(*val))
+                    {
+                        return false;
+                    }
+                    table = static_cast<const table_t*>(val);
+                }
+            }
+            return true;
+        }
+
+        /// Copy the tables to the parent of the last segment. Return the parent.
+        table_t& spine(const std::vector<Segment>& segments)
+        {
+            checkOpen();
+            table_t* table = root_.get();
+            for (size_t i = 0; i + 1 < segments.size(); ++i)
+            {
+                const auto& s = segments[i];
+                if (s.indexed)
+                {
+                    auto& arr = own(*table, s.key, false, TypeTag<array_t>());
+                    table = &ownElement(arr, s.index);
+                }
+                else
+                {
+                    table = &own(*table, s.key, true, TypeTag<table_t>());
+                }
+            }
+            return *table;
+        }
+
+        /// Return the child of the table owned by this transaction, copying it at first.
+        template <class T>
+        T& own(table_t& table, const std::string& key, bool make, TypeTag<T>)
+        {
+            const auto node = table.node(key);
+            if (!node)
+            {
+                if (!make)
+                {
+                    throw KeyNotFound();
+                }
+                const auto made = std::make_shared<T>();
+                owned_.emplace(made.get());
+                table.setValue(key, made);
+                return *made;
+            }
+
+            if (node->type() != ValueTypeOf<T>::value)
+            {
+                throw MismatchType();
+            }
+            if (owned_.count(node.get()))
+            {
+                return const_cast<T&>(static_cast<const T&>(*node));
+            }
+
+            const auto copy = std::make_shared<T>(static_cast<const T&>(*node));
+            owned_.emplace(copy.get());
+            table.setValue(key, copy);
+            return *copy;
+        }
+
+        /// Return the indexed table owned by this transaction, copying it at first.
+        table_t& ownElement(array_t& arr, size_t i)
+        {
+            const auto& elem = arr.valueAs<table_t>(i);
+            if (owned_.count(&elem))
+            {
+                return const_cast<table_t&>(elem);
+            }
+
+            const auto copy = std::make_shared<table_t>(elem);
+            owned_.emplace(copy.get());
+            arr.setValue(i, copy);
+            return *copy;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef SML_SMLVISIT_H
+#define SML_SMLVISIT_H
+
+#include "smldef.h"
+#include "smlobj.h"
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace sml
+{
+    /// Combine function objects into one overload set.
+    /// visit(overloaded{ [](integer_t i) {...}, [](const auto&) {...} }, val);
+    template <class... Fs>
+    struct overloaded : Fs...
+    {
+        using Fs::operator()...;
+    };
+
+    template <class... Fs>
+    overloaded(Fs...) -> overloaded<Fs...>;
+
+    /// Call the function object with the value as its actual type.
+    /// Dispatch is a switch on the type tag, so the call can be inlined.
+    /// All overloads need to return the same type.
+    template <class F>
+    decltype(auto) visit(F&& f, const Value& val)
+    {
+        switch (val.type())
+        {
+        case ValueType::Integer:
+            return f(static_cast<const Integer&>(val).ref());
+        case ValueType::Real:
+            return f(static_cast<const Real&>(val).ref());
+        case ValueType::String:
+            return f(static_cast<const String&>(val).ref());
+        case ValueType::Array:
+            return f(static_cast<const array_t&>(val));
+        case ValueType::Table:
+            return f(static_cast<const table_t&>(val));
+        default:
+            throw MismatchType();
+        }
+    }
+
+    /// Call the function object with the indexed value, or with Null if out of range.
+    template <class F>
+    decltype(auto) visitAt(F&& f, size_t i, const array_t& arr)
+    {
+        if (i >= arr.length())
+        {
+            return f(Null());
+        }
+
+        switch (arr.elementType())
+        {
+        case ValueType::Integer:
+            return f(arr.template valueAs<integer_t>(i));
+        case ValueType::Real:
+            return f(arr.template valueAs<real_t>(i));
+        case ValueType::String:
+            return f(arr.template valueAs<string_t>(i));
+        case ValueType::Array:
+            return f(arr.template valueAs<array_t>(i));
+        case ValueType::Table:
+            return f(arr.template valueAs<table_t>(i));
+        default:
+            throw MismatchType();
+        }
+    }
+
+    /// Call the function object with the value mapped by the key, or with Null if not found.
+    template <class F>
+    decltype(auto) visitAt(F&& f, const std::string& key, const table_t& table)
+    {
+        const auto val = table.find(key);
+        if (!val)
+        {
+            return f(Null());
+        }
+        return visit(std::forward<F>(f), *val);
+    }
+
+    /// ditto
+    template <class F>
+    decltype(auto) visitAt(F&& f, const std::string& key, const std::shared_ptr<const table_t>& table)
+    {
+        return visitAt(std::forward<F>(f), key, *table);
+    }
+
+    /// Call the function object with each element of the array.
+    /// The element type is dispatched once for the whole array.
+    template <class F>
+    void visitEach(F&& f, const array_t& arr)
+    {
+        const auto each = [&](auto range) {
+            for (const auto& e : range)
+            {
+                f(e);
+            }
+        };
+
+        switch (arr.elementType())
+        {
+        case ValueType::Integer:
+            each(arr.template as<integer_t>());
+            break;
+        case ValueType::Real:
+            each(arr.template as<real_t>());
+            break;
+        case ValueType::String:
+            each(arr.template as<string_t>());
+            break;
+        case ValueType::Array:
+            each(arr.template as<array_t>());
+            break;
+        case ValueType::Table:
+            each(arr.template as<table_t>());
+            break;
+        default:
+            break;
+        }
+    }
+
+    namespace detail
+    {
+        template <class F>
+        struct RecursiveVisitor
+        {
+            F& f;
+
+            template <class T>
+            void operator()(const T& val) const
+            {
+                f(val);
+            }
+
+            void operator()(const array_t& arr) const
+            {
+                f(arr);
+                visitEach(*this, arr);
+            }
+
+            void operator()(const table_t& table) const
+            {
+                f(table);
+                for (const auto e : table)
+                {
+                    visit(*this, e.second);
+                }
+            }
+        };
+    }
+
+    /// Call the function object with the value and all of its descendants in depth first order.
+    /// A table or an array is passed before its children.
+    template <class F>
+    void visitRecursive(F&& f, const Value& val)
+    {
+        visit(detail::RecursiveVisitor<std::remove_reference_t<F>>{ f }, val);
+    }
+}
+
+#endif
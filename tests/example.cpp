@@ -1,194 +1,1257 @@
-#include <sml.h>
-#include <CppUTest/CommandLineTestRunner.h>
-
-using namespace sml;
-
-TEST_GROUP(EXAMPLE_TABLE)
-{
-};
-
-TEST(EXAMPLE_TABLE, ReadFile)
-{
-    const auto sml = parse("example.sml");
-    CHECK(!!sml);
-}
-
-TEST(EXAMPLE_TABLE, length)
-{
-    const auto sml = parse("example.sml");
-    CHECK(sml->length() == 10);
-}
-
-TEST(EXAMPLE_TABLE, contains)
-{
-    const auto sml = parse("example.sml");
-
-    CHECK(sml->contains("v_int"));
-    CHECK(sml->contains("v_iarr"));
-    CHECK(sml->contains("v_arr_rec"));
-    CHECK(sml->contains("t_singer"));
-
-    CHECK_FALSE(sml->contains("notexists"));
-    CHECK_FALSE(sml->contains("t_singer.child"));
-}
-
-TEST(EXAMPLE_TABLE, valueIs)
-{
-    const auto sml = parse("example.sml");
-
-    CHECK(valueIs<integer_t>("v_int", sml));
-    CHECK(valueIs<real_t>("v_real", sml));
-    CHECK(valueIs<string_t>("v_str", sml));
-    CHECK(valueIs<array_t>("v_iarr", sml));
-    CHECK(valueIs<array_t>("v_arr_rec", sml));
-    CHECK(valueIs<table_t>("t_singer", sml));
-
-    CHECK_FALSE(valueIs<integer_t>("notexists", sml));
-    CHECK_FALSE(valueIs<real_t>("v_int", sml));
-}
-
-TEST(EXAMPLE_TABLE, valueAs)
-{
-    const auto sml = parse("example.sml");
-
-    CHECK(valueAs<integer_t>("v_int", sml) == 5);
-    CHECK(valueAs<real_t>("v_real", sml) - 10.2 < 0.001);
-    CHECK(valueAs<string_t>("v_str", sml) == "Example String.");
-}
-
-TEST(EXAMPLE_TABLE, GetTable)
-{
-    const auto sml = parse("example.sml");
-
-    const auto& singer = valueAs<table_t>("t_singer", sml);
-    CHECK(valueAs<integer_t>("size", singer) == 72);
-
-    const auto& child = valueAs<table_t>("child", singer);
-    CHECK(valueAs<string_t>("color", child) == "orange");
-    CHECK(valueAs<integer_t>("size", child) == 75);
-    CHECK(valueAs<string_t>( "food", child) == "lol");
-}
-
-TEST(EXAMPLE_TABLE, GetArray)
-{
-    const auto sml = parse("example.sml");
-
-    const auto& iarr = valueAs<array_t>("v_iarr", sml);
-    CHECK(iarr.length() == 3);
-
-    const auto& arr_rec = valueAs<array_t>("v_arr_rec", sml);
-    CHECK(arr_rec.length() == 3);
-}
-
-TEST_GROUP(EXAMPLE_ARRAY)
-{
-};
-
-TEST(EXAMPLE_ARRAY, length)
-{
-    const auto sml = parse("example.sml");
-
-    const auto& iarr = valueAs<array_t>("v_iarr", sml);
-    CHECK(iarr.length() == 3);
-
-    const auto& arr_rec = valueAs<array_t>("v_arr_rec", sml);
-    CHECK(arr_rec.length() == 3);
-}
-
-TEST(EXAMPLE_ARRAY, arrayIs)
-{
-    const auto sml = parse("example.sml");
-
-    const auto& iarr = valueAs<array_t>("v_iarr", sml);
-    CHECK(arrayIs<integer_t>(iarr));
-    CHECK_FALSE(arrayIs<real_t>(iarr));
-    CHECK_FALSE(arrayIs<array_t>(iarr));
-
-    const auto& arr_rec = valueAs<array_t>("v_arr_rec", sml);
-    CHECK(arrayIs<array_t>(arr_rec));
-    CHECK_FALSE(arrayIs<integer_t>(arr_rec));
-}
-
-TEST(EXAMPLE_ARRAY, valueAs)
-{
-    const auto sml = parse("example.sml");
-
-    const auto& iarr = valueAs<array_t>("v_iarr", sml);
-    CHECK(valueAs<integer_t>(0, iarr) == 4);
-    CHECK(valueAs<integer_t>(1, iarr) == 2);
-    CHECK(valueAs<integer_t>(2, iarr) == 5);
-
-    const auto& arr_rec = valueAs<array_t>("v_arr_rec", sml);
-    const auto& arr_rec_1 = valueAs<array_t>(1, arr_rec);
-    CHECK(arrayIs<string_t>(arr_rec_1));
-    CHECK(arr_rec_1.length() == 3);
-    CHECK(valueAs<string_t>(2, arr_rec_1) == "str");
-}
-
-TEST_GROUP(EXAMPLE_TABLE_ARRAY)
-{
-};
-
-TEST(EXAMPLE_TABLE_ARRAY, GetTableArray)
-{
-    const auto sml = parse("example.sml");
-
-    const auto& arr = valueAs<array_t>("tarr", sml);
-    CHECK(arr.length() == 2);
-    CHECK(arrayIs<table_t>(arr));
-
-    const auto& arr_0 = valueAs<table_t>(0, arr);
-    CHECK(arr_0.length() == 1);
-    CHECK(valueIs<integer_t>("id", arr_0));
-    CHECK(valueAs<integer_t>("id", arr_0) == 10);
-
-    const auto& arr_1 = valueAs<table_t>(1, arr);
-    CHECK(arr_1.length() == 1);
-    CHECK(valueIs<integer_t>("kcal", arr_1));
-    CHECK(valueAs<integer_t>("kcal", arr_1) == 44);
-}
-
-TEST(EXAMPLE_TABLE_ARRAY, GetChildTableArray)
-{
-    const auto sml = parse("example.sml");
-
-    const auto& singer = valueAs<table_t>("t_singer", sml);
-    CHECK(valueIs<array_t>("cute", singer));
-
-    const auto& arr = valueAs<array_t>("cute", singer);
-    CHECK(arr.length() == 2);
-    CHECK(arrayIs<table_t>(arr));
-
-    const auto& arr_0 = valueAs<table_t>(0, arr);
-    CHECK(arr_0.length() == 1);
-    CHECK(valueIs<string_t>("type", arr_0));
-    CHECK(valueAs<string_t>("type", arr_0) == "Cool");
-
-    const auto& arr_1 = valueAs<table_t>(1, arr);
-    CHECK(arr_1.length() == 1);
-    CHECK(valueIs<string_t>("who", arr_1));
-    CHECK(valueAs<string_t>("who", arr_1) == "superman");
-}
-
-TEST_GROUP(EXAMPLE_TABLE_PATH)
-{
-};
-
-TEST(EXAMPLE_TABLE_PATH, Priority)
-{
-    const auto sml = parse("example.sml");
-
-	const auto& usa = valueAs<array_t>("usa", sml);
-
-    const auto& usa_0 = valueAs<table_t>(0, usa);
-    CHECK(usa_0.length() == 0);
-
-    const auto& usa_1 = valueAs<table_t>(1, usa);
-    CHECK(usa_1.length() == 1);
-    CHECK(valueIs<table_t>("min", usa_1));
-
-    const auto& min = valueAs<table_t>("min", usa_1);
-    CHECK(min.length() == 1);
-    CHECK(valueIs<integer_t>("age", min));
-    CHECK(valueAs<integer_t>("age", min) == 27);
+#include <sml.h>
+#include <smlmmap.h>
+#include <smlshared.h>
+#include <embedded_example.h>
+#include <Example.h>
+#include <Matrix.h>
+#include <CppUTest/CommandLineTestRunner.h>
+
+using namespace sml;
+
+TEST_GROUP(EXAMPLE_TABLE)
+{
+};
+
+TEST(EXAMPLE_TABLE, ReadFile)
+{
+    const auto sml = parse("example.sml");
+    CHECK(!!sml);
+}
+
+TEST(EXAMPLE_TABLE, length)
+{
+    const auto sml = parse("example.sml");
+    CHECK(sml->length() == 10);
+}
+
+TEST(EXAMPLE_TABLE, contains)
+{
+    const auto sml = parse("example.sml");
+
+    CHECK(sml->contains("v_int"));
+    CHECK(sml->contains("v_iarr"));
+    CHECK(sml->contains("v_arr_rec"));
+    CHECK(sml->contains("t_singer"));
+
+    CHECK_FALSE(sml->contains("notexists"));
+    CHECK_FALSE(sml->contains("t_singer.child"));
+}
+
+TEST(EXAMPLE_TABLE, valueIs)
+{
+    const auto sml = parse("example.sml");
+
+    CHECK(valueIs<integer_t>("v_int", sml));
+    CHECK(valueIs<real_t>("v_real", sml));
+    CHECK(valueIs<string_t>("v_str", sml));
+    CHECK(valueIs<array_t>("v_iarr", sml));
+    CHECK(valueIs<array_t>("v_arr_rec", sml));
+    CHECK(valueIs<table_t>("t_singer", sml));
+
+    CHECK_FALSE(valueIs<integer_t>("notexists", sml));
+    CHECK_FALSE(valueIs<real_t>("v_int", sml));
+}
+
+TEST(EXAMPLE_TABLE, valueAs)
+{
+    const auto sml = parse("example.sml");
+
+    CHECK(valueAs<integer_t>("v_int", sml) == 5);
+    CHECK(valueAs<real_t>("v_real", sml) - 10.2 < 0.001);
+    CHECK(valueAs<string_t>("v_str", sml) == "Example String.");
+}
+
+TEST(EXAMPLE_TABLE, GetTable)
+{
+    const auto sml = parse("example.sml");
+
+    const auto& singer = valueAs<table_t>("t_singer", sml);
+    CHECK(valueAs<integer_t>("size", singer) == 72);
+
+    const auto& child = valueAs<table_t>("child", singer);
+    CHECK(valueAs<string_t>("color", child) == "orange");
+    CHECK(valueAs<integer_t>("size", child) == 75);
+    CHECK(valueAs<string_t>( "food", child) == "lol");
+}
+
+TEST(EXAMPLE_TABLE, GetArray)
+{
+    const auto sml = parse("example.sml");
+
+    const auto& iarr = valueAs<array_t>("v_iarr", sml);
+    CHECK(iarr.length() == 3);
+
+    const auto& arr_rec = valueAs<array_t>("v_arr_rec", sml);
+    CHECK(arr_rec.length() == 3);
+}
+
+TEST(EXAMPLE_TABLE, Iterate)
+{
+    const auto sml = parse("example.sml");
+
+    size_t count = 0;
+    for (const auto e : *sml)
+    {
+        CHECK(sml->contains(e.first));
+        if (e.first == "v_int")
+        {
+            CHECK(valueIs<integer_t>(e.second));
+            CHECK(valueAs<integer_t>(e.second) == 5);
+        }
+        ++count;
+    }
+    CHECK(count == sml->length());
+}
+
+TEST(EXAMPLE_TABLE, Grow)
+{
+    table_t t;
+    for (int i = 0; i < 40; ++i)
+    {
+        t.addValue("key_" + std::to_string(i), std::make_shared<Integer>(i));
+        CHECK(t.length() == static_cast<size_t>(i + 1));
+    }
+    t.addValue("key_3", std::make_shared<Integer>(100));
+
+    for (int i = 0; i < 40; ++i)
+    {
+        CHECK(t.valueAs<integer_t>("key_" + std::to_string(i)) == i);
+    }
+    CHECK_FALSE(t.contains("key_40"));
+    CHECK_FALSE(t.contains("key_"));
+
+    int i = 0;
+    for (const auto e : t)
+    {
+        CHECK(e.first == "key_" + std::to_string(i++));
+    }
+}
+
+TEST(EXAMPLE_TABLE, KeyPool)
+{
+    const auto keyOf = [](const table_t& t, const std::string& key) {
+        for (const auto e : t)
+        {
+            if (e.first == key)
+            {
+                return &e.first;
+            }
+        }
+        return static_cast<const std::string*>(nullptr);
+    };
+
+    const auto pool = std::make_shared<KeyPool>();
+    const auto a = parse("example.sml", pool);
+    const auto count = pool->size();
+    const auto b = parse("example.sml", pool);
+    CHECK(pool->size() == count);
+
+    const auto& singer = valueAs<table_t>("t_singer", a);
+    CHECK(keyOf(singer, "size") == keyOf(valueAs<table_t>("child", singer), "size"));
+    CHECK(keyOf(*a, "v_int") == keyOf(*b, "v_int"));
+    CHECK(keyOf(*a, "v_int") != keyOf(*parse("example.sml"), "v_int"));
+
+    CHECK(pool->collect() == 0);
+}
+
+TEST(EXAMPLE_TABLE, Shape)
+{
+    table_t a, b, c, d;
+    a.addValue("id", std::make_shared<Integer>(1));
+    a.addValue("name", std::make_shared<String>("a"));
+
+    b.adoptShape(a);
+    b.addValue("id", std::make_shared<Integer>(2));
+    b.addValue("name", std::make_shared<String>("b"));
+    CHECK(b.shape() == a.shape());
+
+    c.adoptShape(a);
+    c.addValue("id", std::make_shared<Integer>(3));
+    c.addValue("size", std::make_shared<Integer>(4));
+    CHECK(c.shape() != a.shape());
+    CHECK(c.contains("size"));
+    CHECK_FALSE(c.contains("name"));
+    CHECK_FALSE(a.contains("size"));
+
+    d.adoptShape(a);
+    d.addValue("id", std::make_shared<Integer>(5));
+    CHECK(d.shape() == a.shape());
+    CHECK(d.length() == 1);
+    CHECK_FALSE(d.contains("name"));
+
+    const CachedKey id("id");
+    const CachedKey name("name");
+    CHECK(valueAs<integer_t>(id, a) == 1);
+    CHECK(valueAs<integer_t>(id, b) == 2);
+    CHECK(valueAs<integer_t>(id, c) == 3);
+    CHECK(valueAs<string_t>(name, b) == "b");
+    CHECK_FALSE(valueIs<string_t>(name, c));
+    CHECK_FALSE(valueIs<string_t>(name, d));
+    CHECK_THROWS(KeyNotFound, valueAs<string_t>(name, d));
+}
+
+TEST(EXAMPLE_TABLE, Dedup)
+{
+    const auto plain = parse("example.sml");
+
+    DedupStats stats;
+    ParseOptions options;
+    options.dedup = true;
+    options.dedupStats = &stats;
+    const auto sml = parse("example.sml", options);
+
+    // No value of example.sml repeats
+    CHECK(stats.bytes == 0);
+    CHECK(sml->length() == plain->length());
+
+    const auto& usa = valueAs<array_t>("usa", sml);
+    CHECK(&valueAs<table_t>(0, usa) != &valueAs<table_t>(1, usa));
+    CHECK(valueAs<integer_t>("age", valueAs<table_t>("min", valueAs<table_t>(1, usa))) == 27);
+
+    table_t t;
+    for (int i = 0; i < 4; ++i)
+    {
+        const auto child = std::make_shared<table_t>();
+        child->addValue("host", std::make_shared<String>("example.com"));
+        child->addValue("port", std::make_shared<Integer>(80));
+        t.addValue("region" + std::to_string(i), child);
+    }
+    stats = dedup(t);
+    CHECK(stats.tables == 3);
+    CHECK(stats.values == 6);
+    CHECK(stats.bytes >= 3 * sizeof(table_t));
+    CHECK(&valueAs<table_t>("region0", t) == &valueAs<table_t>("region3", t));
+    CHECK(valueAs<string_t>("host", valueAs<table_t>("region2", t)) == "example.com");
+}
+
+TEST(EXAMPLE_TABLE, Hash)
+{
+    const auto a = parse("example.sml");
+    const auto b = parse("example.sml");
+    CHECK(a->hash() == b->hash());
+    CHECK(equal(*a, *b));
+    CHECK_FALSE(equal(valueAs<table_t>("t_singer", a), *b));
+
+    table_t x, y;
+    x.addValue("a", std::make_shared<Integer>(1));
+    x.addValue("b", std::make_shared<String>("2"));
+    y.addValue("b", std::make_shared<String>("2"));
+    y.addValue("a", std::make_shared<Integer>(1));
+    CHECK(x.hash() == y.hash());
+    CHECK(equal(x, y));
+
+    y.addValue("c", std::make_shared<Real>(3.0f));
+    CHECK(x.hash() != y.hash());
+    CHECK_FALSE(equal(x, y));
+
+    // Packed or not, equal arrays hash equally
+    array_t mat;
+    for (int r = 0; r < 2; ++r)
+    {
+        const auto row = std::make_shared<array_t>();
+        for (int c = 1; c <= 3; ++c)
+        {
+            row->insertBack(r * 3 + c);
+        }
+        mat.insertBack(row);
+    }
+    const auto matrix = parse("matrix.sml");
+    const auto& packed = valueAs<array_t>("v_mat", matrix);
+    CHECK(packed.packed());
+    CHECK_FALSE(mat.packed());
+    CHECK(mat.hash() == packed.hash());
+    CHECK(equal(mat, packed));
+}
+
+TEST_GROUP(EXAMPLE_ARRAY)
+{
+};
+
+TEST(EXAMPLE_ARRAY, length)
+{
+    const auto sml = parse("example.sml");
+
+    const auto& iarr = valueAs<array_t>("v_iarr", sml);
+    CHECK(iarr.length() == 3);
+
+    const auto& arr_rec = valueAs<array_t>("v_arr_rec", sml);
+    CHECK(arr_rec.length() == 3);
+}
+
+TEST(EXAMPLE_ARRAY, arrayIs)
+{
+    const auto sml = parse("example.sml");
+
+    const auto& iarr = valueAs<array_t>("v_iarr", sml);
+    CHECK(arrayIs<integer_t>(iarr));
+    CHECK_FALSE(arrayIs<real_t>(iarr));
+    CHECK_FALSE(arrayIs<array_t>(iarr));
+
+    const auto& arr_rec = valueAs<array_t>("v_arr_rec", sml);
+    CHECK(arrayIs<array_t>(arr_rec));
+    CHECK_FALSE(arrayIs<integer_t>(arr_rec));
+}
+
+TEST(EXAMPLE_ARRAY, valueAs)
+{
+    const auto sml = parse("example.sml");
+
+    const auto& iarr = valueAs<array_t>("v_iarr", sml);
+    CHECK(valueAs<integer_t>(0, iarr) == 4);
+    CHECK(valueAs<integer_t>(1, iarr) == 2);
+    CHECK(valueAs<integer_t>(2, iarr) == 5);
+
+    const auto& arr_rec = valueAs<array_t>("v_arr_rec", sml);
+    const auto& arr_rec_1 = valueAs<array_t>(1, arr_rec);
+    CHECK(arrayIs<string_t>(arr_rec_1));
+    CHECK(arr_rec_1.length() == 3);
+    CHECK(valueAs<string_t>(2, arr_rec_1) == "str");
+}
+
+TEST(EXAMPLE_ARRAY, as)
+{
+    const auto sml = parse("example.sml");
+
+    const auto& iarr = valueAs<array_t>("v_iarr", sml);
+    const auto range = as<integer_t>(iarr);
+    CHECK(range.size() == 3);
+
+    integer_t sum = 0;
+    for (integer_t i : range)
+    {
+        sum += i;
+    }
+    CHECK(sum == 11);
+
+    const auto& tarr = valueAs<array_t>("tarr", sml);
+    size_t count = 0;
+    for (const auto& t : tarr.as<table_t>())
+    {
+        CHECK(t.length() == 1);
+        ++count;
+    }
+    CHECK(count == 2);
+
+    CHECK_THROWS(MismatchType, as<real_t>(iarr));
+}
+
+TEST(EXAMPLE_ARRAY, ndview)
+{
+    const auto sml = parse("matrix.sml");
+
+    const auto& mat = valueAs<array_t>("v_mat", sml);
+    CHECK(mat.packed());
+    const auto view = mat.ndview<integer_t>();
+    CHECK(view.rank() == 2);
+    CHECK(view.shape()[0] == 2);
+    CHECK(view.shape()[1] == 3);
+    CHECK(view.size() == 6);
+    CHECK(view(1, 2) == 6);
+    CHECK(view.data()[3] == 4);
+
+    const auto& row = valueAs<array_t>(1, mat);
+    CHECK(arrayIs<integer_t>(row));
+    CHECK(row.length() == 3);
+    CHECK(valueAs<integer_t>(0, row) == 4);
+
+    const auto& cube = valueAs<array_t>("v_cube", sml);
+    const auto cview = ndview<real_t>(cube);
+    CHECK(cview.rank() == 3);
+    CHECK(cview(1, 0, 1) - 6.0 < 0.001);
+    CHECK(ndview<real_t>(valueAs<array_t>(1, cube)).rank() == 2);
+    const auto& leaf = valueAs<array_t>(1, valueAs<array_t>(1, cube));
+    CHECK(valueAs<real_t>(1, leaf) - 8.0 < 0.001);
+
+    CHECK_FALSE(valueAs<array_t>("v_arr_rec", parse("example.sml")).packed());
+    CHECK_THROWS(MismatchType, mat.ndview<real_t>());
+}
+
+TEST(EXAMPLE_ARRAY, ModifyPackedRow)
+{
+    const auto sml = parse("matrix.sml");
+    auto& mat = const_cast<array_t&>(valueAs<array_t>("v_mat", sml));
+
+    auto& row = mat.valueAs<array_t>(0);
+    row.insertBack(9);
+    CHECK(row.length() == 4);
+    CHECK_FALSE(row.packed());
+    CHECK_FALSE(mat.packed());
+    CHECK_THROWS(MismatchType, mat.ndview<integer_t>());
+    CHECK(valueAs<integer_t>(3, valueAs<array_t>(0, mat)) == 9);
+    CHECK(valueAs<integer_t>(2, valueAs<array_t>(1, mat)) == 6);
+    CHECK(equal(mat, *Parser().parseText("m = [[1, 2, 3, 9], [4, 5, 6]]")->node("m")));
+
+    auto& cube = const_cast<array_t&>(valueAs<array_t>("v_cube", sml));
+    cube.valueAs<array_t>(1).valueAs<array_t>(0).insertBack(real_t(0.5));
+    CHECK_FALSE(cube.packed());
+    CHECK_FALSE(cube.valueAs<array_t>(1).packed());
+    CHECK(cube.valueAs<array_t>(0).length() == 2);
+    CHECK(valueAs<real_t>(2, valueAs<array_t>(0, valueAs<array_t>(1, cube))) == real_t(0.5));
+
+    // Equal rows pack again
+    cube.valueAs<array_t>(1).valueAs<array_t>(1).insertBack(real_t(0.5));
+    CHECK(cube.valueAs<array_t>(1).pack());
+    CHECK(cube.valueAs<array_t>(1).ndview<real_t>()(1, 2) == real_t(0.5));
+}
+
+TEST(EXAMPLE_ARRAY, applyVisitorEach)
+{
+    const auto sml = parse("example.sml");
+
+    struct SumVisitor : Visitor
+    {
+        size_t calls = 0;
+        real_t sum = 0;
+
+        void visit(span<const real_t> s) override
+        {
+            ++calls;
+            for (const auto r : s)
+            {
+                sum += r;
+            }
+        }
+    };
+    SumVisitor sum;
+    applyVisitorEach(sum, valueAs<array_t>("v_rarr", sml));
+    CHECK(sum.calls == 1);
+    CHECK(sum.sum - (3.2 + 10.65 + 5.222) < 0.001);
+
+    struct CountVisitor : Visitor
+    {
+        size_t count = 0;
+
+        void visit(const integer_t&) override
+        {
+            ++count;
+        }
+    };
+    CountVisitor count;
+    applyVisitorEach(count, valueAs<array_t>("v_iarr", sml));
+    CHECK(count.count == 3);
+}
+
+TEST(EXAMPLE_ARRAY, copyTo)
+{
+    const auto sml = parse("example.sml");
+
+    const auto& iarr = valueAs<array_t>("v_iarr", sml);
+    long long wide[3] = {};
+    iarr.copyTo<integer_t>(wide);
+    CHECK(wide[0] == 4);
+    CHECK(wide[1] == 2);
+    CHECK(wide[2] == 5);
+
+    const auto& rarr = valueAs<array_t>("v_rarr", sml);
+    alignas(32) double reals[3] = {};
+    copyTo<real_t, 32>(rarr, reals);
+    CHECK(reals[1] - 10.65 < 0.001);
+
+    const auto v = valueAs<std::vector<real_t>>("v_rarr", sml);
+    CHECK(v.size() == 3);
+    CHECK(v[2] - 5.222 < 0.001);
+
+    const auto s = valueAs<std::vector<std::string>>("v_sarr", sml);
+    CHECK(s.size() == 2);
+    CHECK(s[1] == "string");
+
+    CHECK_THROWS(MismatchType, valueAs<std::vector<real_t>>("v_iarr", sml));
+}
+
+TEST_GROUP(EXAMPLE_TABLE_ARRAY)
+{
+};
+
+TEST(EXAMPLE_TABLE_ARRAY, GetTableArray)
+{
+    const auto sml = parse("example.sml");
+
+    const auto& arr = valueAs<array_t>("tarr", sml);
+    CHECK(arr.length() == 2);
+    CHECK(arrayIs<table_t>(arr));
+
+    const auto& arr_0 = valueAs<table_t>(0, arr);
+    CHECK(arr_0.length() == 1);
+    CHECK(valueIs<integer_t>("id", arr_0));
+    CHECK(valueAs<integer_t>("id", arr_0) == 10);
+
+    const auto& arr_1 = valueAs<table_t>(1, arr);
+    CHECK(arr_1.length() == 1);
+    CHECK(valueIs<integer_t>("kcal", arr_1));
+    CHECK(valueAs<integer_t>("kcal", arr_1) == 44);
+}
+
+TEST(EXAMPLE_TABLE_ARRAY, GetChildTableArray)
+{
+    const auto sml = parse("example.sml");
+
+    const auto& singer = valueAs<table_t>("t_singer", sml);
+    CHECK(valueIs<array_t>("cute", singer));
+
+    const auto& arr = valueAs<array_t>("cute", singer);
+    CHECK(arr.length() == 2);
+    CHECK(arrayIs<table_t>(arr));
+
+    const auto& arr_0 = valueAs<table_t>(0, arr);
+    CHECK(arr_0.length() == 1);
+    CHECK(valueIs<string_t>("type", arr_0));
+    CHECK(valueAs<string_t>("type", arr_0) == "Cool");
+
+    const auto& arr_1 = valueAs<table_t>(1, arr);
+    CHECK(arr_1.length() == 1);
+    CHECK(valueIs<string_t>("who", arr_1));
+    CHECK(valueAs<string_t>("who", arr_1) == "superman");
+}
+
+TEST_GROUP(EXAMPLE_TABLE_PATH)
+{
+};
+
+TEST(EXAMPLE_TABLE_PATH, Priority)
+{
+    const auto sml = parse("example.sml");
+
+	const auto& usa = valueAs<array_t>("usa", sml);
+
+    const auto& usa_0 = valueAs<table_t>(0, usa);
+    CHECK(usa_0.length() == 0);
+
+    const auto& usa_1 = valueAs<table_t>(1, usa);
+    CHECK(usa_1.length() == 1);
+    CHECK(valueIs<table_t>("min", usa_1));
+
+    const auto& min = valueAs<table_t>("min", usa_1);
+    CHECK(min.length() == 1);
+    CHECK(valueIs<integer_t>("age", min));
+    CHECK(valueAs<integer_t>("age", min) == 27);
+}
+
+TEST_GROUP(EXAMPLE_VISIT)
+{
+};
+
+TEST(EXAMPLE_VISIT, visit)
+{
+    const auto sml = parse("example.sml");
+
+    const auto name = [](const auto& val) {
+        return visit(overloaded{
+            [](integer_t) { return std::string("integer"); },
+            [](real_t) { return std::string("real"); },
+            [](const string_t&) { return std::string("string"); },
+            [](const array_t&) { return std::string("array"); },
+            [](const table_t&) { return std::string("table"); },
+        }, val);
+    };
+    CHECK(name(*sml) == "table");
+    CHECK(name(valueAs<array_t>("v_iarr", sml)) == "array");
+
+    const auto isNull = overloaded{
+        [](Null) { return true; },
+        [](const auto&) { return false; },
+    };
+    CHECK(visitAt(isNull, "notexists", sml));
+    CHECK_FALSE(visitAt(isNull, "v_int", sml));
+    CHECK(visitAt(isNull, 3, valueAs<array_t>("v_iarr", sml)));
+    CHECK_FALSE(visitAt(isNull, 2, valueAs<array_t>("v_iarr", sml)));
+}
+
+TEST(EXAMPLE_VISIT, visitRecursive)
+{
+    const auto sml = parse("example.sml");
+
+    size_t integers = 0;
+    size_t reals = 0;
+    size_t tables = 0;
+    integer_t sum = 0;
+    visitRecursive(overloaded{
+        [&](integer_t i) { ++integers; sum += i; },
+        [&](real_t) { ++reals; },
+        [&](const table_t&) { ++tables; },
+        [](const auto&) {},
+    }, *sml);
+
+    CHECK(integers == 11);
+    CHECK(sum == 5 + 4 + 2 + 5 + 2 + 4 + 72 + 75 + 10 + 44 + 27);
+    CHECK(reals == 7);
+    CHECK(tables == 10);
+}
+
+TEST_GROUP(EXAMPLE_FROZEN)
+{
+};
+
+TEST(EXAMPLE_FROZEN, valueAs)
+{
+    const auto doc = freeze(parse("example.sml"));
+    const auto sml = doc.root();
+
+    CHECK(sml.length() == 10);
+    CHECK(sml.contains("v_int"));
+    CHECK_FALSE(sml.contains("notexists"));
+    CHECK(valueIs<integer_t>("v_int", sml));
+    CHECK_FALSE(valueIs<real_t>("v_int", sml));
+
+    CHECK(valueAs<integer_t>("v_int", sml) == 5);
+    CHECK(valueAs<real_t>("v_real", sml) - 10.2 < 0.001);
+    CHECK(valueAs<string_t>("v_str", sml) == "Example String.");
+    CHECK_THROWS(KeyNotFound, valueAs<integer_t>("notexists", sml));
+    CHECK_THROWS(MismatchType, valueAs<string_t>("v_int", sml));
+
+    const auto child = valueAs<table_t>("child", valueAs<table_t>("t_singer", sml));
+    CHECK(valueAs<string_t>("color", child) == "orange");
+    CHECK(valueAs<integer_t>("size", child) == 75);
+
+    size_t count = 0;
+    for (const auto e : sml)
+    {
+        CHECK(sml.contains(e.first));
+        ++count;
+    }
+    CHECK(count == 10);
+}
+
+TEST(EXAMPLE_FROZEN, Array)
+{
+    const auto doc = freeze(parse("example.sml"));
+    const auto sml = doc.root();
+
+    const auto iarr = valueAs<array_t>("v_iarr", sml);
+    CHECK(arrayIs<integer_t>(iarr));
+    CHECK(iarr.length() == 3);
+    CHECK(valueAs<integer_t>(2, iarr) == 5);
+
+    const auto sarr = valueAs<array_t>("v_sarr", sml);
+    CHECK(valueAs<string_t>(1, sarr) == "string");
+
+    const auto arr_rec = valueAs<array_t>("v_arr_rec", sml);
+    CHECK(valueAs<string_t>(2, valueAs<array_t>(1, arr_rec)) == "str");
+    CHECK(valueAs<std::vector<real_t>>("v_rarr", sml).size() == 3);
+
+    const auto tarr = valueAs<array_t>("tarr", sml);
+    CHECK(arrayIs<table_t>(tarr));
+    CHECK(valueAs<integer_t>("kcal", valueAs<table_t>(1, tarr)) == 44);
+
+    const auto matrix = freeze(parse("matrix.sml"));
+    const auto mat = valueAs<array_t>("v_mat", matrix.root());
+    CHECK(mat.packed());
+    CHECK(mat.ndview<integer_t>()(1, 2) == 6);
+    CHECK(valueAs<integer_t>(0, valueAs<array_t>(1, mat)) == 4);
+    CHECK(valueAs<array_t>("v_cube", matrix.root()).ndview<real_t>()(1, 1, 0) - 7.0 < 0.001);
+}
+
+TEST(EXAMPLE_FROZEN, Relocate)
+{
+    const auto doc = freeze(parse("example.sml"));
+    const auto moved = FrozenDocument(allocateFrozen(doc.data(), doc.size()), doc.size());
+
+    CHECK(moved.data() != doc.data());
+    CHECK(valueAs<string_t>("food", valueAs<table_t>("child", valueAs<table_t>("t_singer", moved.root()))) == "lol");
+}
+
+TEST(EXAMPLE_FROZEN, Broken)
+{
+    const auto doc = freeze(parse("matrix.sml"));
+    const auto adopt = [&](const std::function<void(unsigned char*)>& breaks) {
+        std::vector<unsigned char> bytes(doc.data(), doc.data() + doc.size());
+        breaks(bytes.data());
+        return FrozenDocument(allocateFrozen(bytes.data(), bytes.size()), bytes.size());
+    };
+    const auto header = [](unsigned char* p) { return reinterpret_cast<frozen::Header*>(p); };
+    const auto rootEntry = [&](unsigned char* p) {
+        return reinterpret_cast<frozen::Entry*>(p + header(p)->root + sizeof(frozen::TableHeader));
+    };
+
+    CHECK(adopt([](unsigned char*) {}).root().length() == 2);
+    CHECK_THROWS(ParseException, adopt([&](unsigned char* p) { header(p)->layout.realSize = 2; }));
+    CHECK_THROWS(ParseException, adopt([&](unsigned char* p) { header(p)->layout.integerSize = 2; }));
+    CHECK_THROWS(ParseException, adopt([&](unsigned char* p) { header(p)->layout.byteOrder = 0x04030201; }));
+    CHECK_THROWS(ParseException, adopt([&](unsigned char* p) { rootEntry(p)->key = header(p)->size; }));
+    CHECK_THROWS(ParseException, adopt([&](unsigned char* p) { rootEntry(p)->value.offset = header(p)->size; }));
+    CHECK_THROWS(ParseException, adopt([&](unsigned char* p) { rootEntry(p)->value.offset = header(p)->root; }));
+    CHECK_THROWS(ParseException, adopt([&](unsigned char* p) {
+        const auto arr = reinterpret_cast<frozen::ArrayHeader*>(p + rootEntry(p)->value.offset);
+        arr->count = header(p)->size;
+    }));
+    CHECK_THROWS(ParseException, adopt([&](unsigned char* p) {
+        const auto arr = reinterpret_cast<frozen::ArrayHeader*>(p + rootEntry(p)->value.offset);
+        arr->dense = header(p)->size - sizeof(real_t);
+    }));
+}
+
+TEST(EXAMPLE_FROZEN, PerfectHash)
+{
+    FreezeOptions options;
+    options.perfectHash = true;
+    options.perfectHashMinKeys = 1;
+
+    const auto doc = freeze(parse("example.sml"), options);
+    const auto sml = doc.root();
+    CHECK(valueAs<integer_t>("v_int", sml) == 5);
+    CHECK(valueAs<string_t>("food", valueAs<table_t>("child", valueAs<table_t>("t_singer", sml))) == "lol");
+    CHECK_FALSE(sml.contains("notexists"));
+    for (const auto e : sml)
+    {
+        CHECK(sml.contains(e.first));
+    }
+
+    table_t wide;
+    for (integer_t i = 0; i < 500; ++i)
+    {
+        wide.addValue("key" + std::to_string(i), std::make_shared<Integer>(i));
+    }
+    const auto wideDoc = freeze(wide, options);
+    for (integer_t i = 0; i < 500; ++i)
+    {
+        CHECK(valueAs<integer_t>("key" + std::to_string(i), wideDoc.root()) == i);
+    }
+    CHECK_FALSE(wideDoc.root().contains("key500"));
+    CHECK_FALSE(wideDoc.root().contains(""));
+}
+
+TEST(EXAMPLE_FROZEN, Binary)
+{
+    const auto doc = freeze(parse("example.sml"));
+    CHECK(doc.verify());
+    saveFrozen(doc, "example.smlb");
+
+    {
+        const auto loaded = loadFrozen("example.smlb");
+        CHECK(loaded.data() != doc.data());
+        const auto sml = loaded.root();
+        CHECK(sml.length() == 10);
+        CHECK(valueAs<integer_t>("v_int", sml) == 5);
+        CHECK(valueAs<string_t>("v_str", sml) == "Example String.");
+        CHECK(valueAs<integer_t>("size", valueAs<table_t>("child", valueAs<table_t>("t_singer", sml))) == 75);
+        CHECK(valueAs<std::vector<int>>("v_iarr", sml) == std::vector<int>({ 4, 2, 5 }));
+
+        const auto mapped = mapFrozen("example.smlb");
+        CHECK(mapped.size() == loaded.size());
+        CHECK(std::memcmp(mapped.data(), loaded.data(), loaded.size()) == 0);
+    }
+
+    // Flip a byte of the body
+    {
+        std::fstream f("example.smlb", std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(static_cast<std::streamoff>(doc.size() - 1));
+        f.put('\x7f');
+    }
+    CHECK_THROWS(ParseException, loadFrozen("example.smlb"));
+    CHECK_THROWS(ParseException, mapFrozen("example.smlb"));
+    CHECK(loadFrozen("example.smlb", false).root().length() == 10);
+
+    {
+        std::ofstream out("example.smlb", std::ios::trunc);
+        out << "v_int = 5\n";
+    }
+    CHECK_THROWS(ParseException, loadFrozen("example.smlb"));
+    CHECK_THROWS(ParseException, loadFrozen("notexists.smlb"));
+    CHECK_THROWS(ParseException, mapFrozen("notexists.smlb"));
+    std::remove("example.smlb");
+}
+
+TEST(EXAMPLE_FROZEN, parseCached)
+{
+    std::filesystem::remove_all("smlcache");
+    const auto count = [] {
+        return std::distance(std::filesystem::directory_iterator("smlcache"), std::filesystem::directory_iterator());
+    };
+
+    const auto first = parseCached("example.sml", "smlcache");
+    CHECK(count() == 1);
+    CHECK(valueAs<integer_t>("v_int", first.root()) == 5);
+
+    const auto second = parseCached("example.sml", "smlcache", FreezeOptions(), mapFrozen);
+    CHECK(count() == 1);
+    CHECK(second.size() == first.size());
+    CHECK(std::memcmp(second.data(), first.data(), first.size()) == 0);
+
+    const auto other = parseCached("example2.sml", "smlcache");
+    CHECK(count() == 2);
+    CHECK(valueAs<string_t>("v_new", other.root()) == "New String.");
+
+    CHECK(equal(*Parser().parseText("a = 1\r\n[b]\r\nc = \"d\"\r\n"), *Parser().parseText("a = 1\n[b]\nc = \"d\"")));
+    std::filesystem::remove_all("smlcache");
+}
+
+TEST(EXAMPLE_FROZEN, Shared)
+{
+    SharedPublisher::remove("/sml_example", 2);
+    SharedPublisher publisher("/sml_example");
+    CHECK_THROWS(std::runtime_error, SharedPublisher("/sml_example"));
+    CHECK_THROWS(std::runtime_error, SharedDocument("/sml_example"));
+    CHECK_THROWS(std::runtime_error, SharedDocument("/sml_notexists"));
+
+    CHECK(publisher.publish(*parse("example.sml")) == 1);
+    SharedDocument worker("/sml_example");
+    CHECK(worker.generation() == 1);
+    CHECK_FALSE(worker.changed());
+    CHECK_FALSE(worker.refresh());
+    CHECK(valueAs<string_t>("v_str", worker.root()) == "Example String.");
+
+    const auto old = worker.document();
+    CHECK(publisher.publish(*parse("example2.sml")) == 2);
+    CHECK(worker.changed());
+    CHECK(worker.refresh());
+    CHECK(worker.generation() == 2);
+    CHECK(valueAs<string_t>("v_new", worker.root()) == "New String.");
+    CHECK(valueAs<string_t>("v_str", old.root()) == "Example String.");
+}
+
+TEST(EXAMPLE_FROZEN, Embedded)
+{
+    const auto& doc = embedded_example();
+    CHECK(reinterpret_cast<uintptr_t>(doc.data()) % frozen::Align == 0);
+    CHECK(std::memcmp(doc.data(), freeze(parse("example.sml")).data(), doc.size()) == 0);
+    CHECK(valueAs<integer_t>("v_int", doc.root()) == 5);
+    CHECK(&embedded_example() == &doc);
+}
+
+TEST_GROUP(EXAMPLE_LITERAL)
+{
+};
+
+TEST(EXAMPLE_LITERAL, parseLiteral)
+{
+    static constexpr auto doc = SML_LITERAL(R"(
+v_int = -5 # comment
+v_real = 10.25
+v_str = "Example String."
+v_mat = [[1, 2, 3], [4, 5, 6]]
+
+[t_singer]
+size = 72
+
+[t_singer.child]
+color = "orange"
+
++[tarr]
+id = 10
+
++[tarr]
+kcal = 44
+)");
+
+    constexpr auto root = doc.root();
+    static_assert(valueAs<integer_t>("v_int", root) == -5, "");
+    static_assert(valueAs<real_t>("v_real", root) == 10.25, "");
+    static_assert(valueAs<string_t>("v_str", root) == "Example String.", "");
+    static_assert(valueIs<table_t>("t_singer", root) && !valueIs<integer_t>("t_singer", root), "");
+    static_assert(valueAs<string_t>("color", valueAs<table_t>("child", valueAs<table_t>("t_singer", root))) == "orange", "");
+    static_assert(valueAs<integer_t>(2, valueAs<array_t>(1, valueAs<array_t>("v_mat", root))) == 6, "");
+    static_assert(valueAs<integer_t>("kcal", valueAs<table_t>(1, valueAs<array_t>("tarr", root))) == 44, "");
+
+    static_assert(doc.size() == 22 && doc.capacity() == doc.size(), "");
+
+    CHECK(root.length() == 6);
+    CHECK(literalSize("a = [[1, 2], [3]]\n+[t]\n+[t]\n") == 10);
+    CHECK_THROWS(KeyNotFound, valueAs<integer_t>("none", root));
+    CHECK_THROWS(MismatchType, valueAs<string_t>("v_int", root));
+    CHECK_THROWS(ParseException, parseLiteral("a = \n"));
+    CHECK_THROWS(ParseException, parseLiteral("a = 1\na = 2\n"));
+    CHECK_THROWS(ParseException, parseLiteral("[a.b]\n"));
+    CHECK_THROWS(MismatchType, parseLiteral("a = [1, \"b\"]\n"));
+}
+
+TEST_GROUP(EXAMPLE_GEN)
+{
+};
+
+TEST(EXAMPLE_GEN, load)
+{
+    const auto sml = gen::load<ExampleSchema>("example.sml");
+    CHECK(sml.v_int == 5);
+    CHECK(sml.v_str == std::string("Example String."));
+    CHECK_FALSE(sml.v_new.has_value());
+    CHECK(sml.v_iarr == std::vector<integer_t>({ 4, 2, 5 }));
+    CHECK(valueAs<array_t>(*sml.v_arr_rec).length() == 3);
+    CHECK(sml.t_singer.name == std::vector<std::string>({ "blue", "bird" }));
+    CHECK(sml.t_singer.child.color == "orange");
+    CHECK(sml.t_singer.cute.size() == 2 && sml.t_singer.cute[1].who == std::string("superman"));
+    CHECK(sml.tarr.size() == 2 && sml.tarr[0].id == 10 && !sml.tarr[0].kcal);
+    CHECK(sml.usa.size() == 2 && !sml.usa[0].min && sml.usa[1].min->age == 27);
+
+    const auto matrix = gen::load<MatrixSchema>("matrix.sml");
+    CHECK(matrix.v_mat == std::vector<std::vector<integer_t>>({ { 1, 2, 3 }, { 4, 5, 6 } }));
+    CHECK(matrix.v_cube[1][1][0] == 7.0);
+
+    const auto sml2 = gen::load<ExampleSchema>("example2.sml");
+    CHECK(sml2.v_new == std::string("New String."));
+    CHECK(sml2.tarr.size() == 3);
+
+    // Keys in the order of the schema take the specialized parser
+    ExampleSchema::Root root;
+    CHECK(gen::parseText<ExampleSchema>("v_int = 1\nv_real = 2.0\nv_iarr = [3]\nv_rarr = [1.5]\nv_sarr = [\"a\"]\n"
+                                        "v_arr_rec = [1]\n"
+                                        "[t_singer]\nname = [\"n\"]\nsize = 1\n[t_singer.child]\ncolor = \"c\"\nsize = 2\nfood = \"f\"\n",
+                                        root));
+    CHECK(root.t_singer.child.size == 2);
+
+    // Others fall back to the generic parser
+    const auto text = "v_real = 2.0\nv_int = 1\nunknown = 3\nv_iarr = [3]\nv_rarr = [1.5]\nv_sarr = [\"a\"]\n"
+                      "[t_singer]\nname = [\"n\"]\nsize = 1\n[t_singer.child]\ncolor = \"c\"\nsize = 2\nfood = \"f\"\n";
+    CHECK_FALSE(gen::parseText<ExampleSchema>(text, root = ExampleSchema::Root()));
+    const auto fallback = gen::loadText<ExampleSchema>(text);
+    CHECK(fallback.v_int == 1 && fallback.t_singer.child.food == "f");
+    CHECK_FALSE(fallback.v_arr_rec);
+
+    CHECK_THROWS(KeyNotFound, gen::loadText<ExampleSchema>("v_int = 1\n"));
+    CHECK_THROWS(MismatchType, gen::loadText<ExampleSchema>("v_str = 1\n" + std::string(text)));
+}
+
+struct BoundChild
+{
+    std::string color;
+    int size;
+    std::optional<std::string> food;
+};
+SML_BIND(BoundChild, color, size, food)
+
+struct BoundSinger
+{
+    std::vector<std::string> name;
+    long size;
+    BoundChild child;
+};
+SML_BIND(BoundSinger, name, size, child)
+
+struct BoundTarr
+{
+    std::optional<int> id;
+    std::optional<int> kcal;
+};
+SML_BIND(BoundTarr, id, kcal)
+
+struct BoundConf
+{
+    int v_int;
+    float v_real;
+    std::vector<int> v_iarr;
+    BoundSinger t_singer;
+    std::vector<BoundTarr> tarr;
+    std::optional<std::string> v_new;
+};
+SML_BIND(BoundConf, v_int, v_real, v_iarr, t_singer, tarr, v_new)
+
+struct BoundMatrix
+{
+    std::vector<std::vector<int>> v_mat;
+    std::vector<std::vector<std::vector<double>>> v_cube;
+};
+SML_BIND(BoundMatrix, v_mat, v_cube)
+
+TEST_GROUP(EXAMPLE_BIND)
+{
+};
+
+TEST(EXAMPLE_BIND, bind)
+{
+    const auto conf = bindAs<BoundConf>(parse("example.sml"));
+    CHECK(conf.v_int == 5);
+    CHECK(conf.v_real == 10.2f);
+    CHECK(conf.v_iarr == std::vector<int>({ 4, 2, 5 }));
+    CHECK(conf.t_singer.name == std::vector<std::string>({ "blue", "bird" }));
+    CHECK(conf.t_singer.child.size == 75 && conf.t_singer.child.food == std::string("lol"));
+    CHECK(conf.tarr.size() == 2 && conf.tarr[0].id == 10 && !conf.tarr[0].kcal && conf.tarr[1].kcal == 44);
+    CHECK_FALSE(conf.v_new.has_value());
+
+    const auto matrix = bindAs<BoundMatrix>(parse("matrix.sml"));
+    CHECK(matrix.v_mat == std::vector<std::vector<int>>({ { 1, 2, 3 }, { 4, 5, 6 } }));
+    CHECK(matrix.v_cube[1][1][0] == 7.0);
+
+    const auto conf2 = bindAs<BoundConf>(parse("example2.sml"));
+    CHECK(conf2.v_new == std::string("New String."));
+    CHECK(conf2.tarr.size() == 3);
+
+    const auto child = Parser().parseText("color = \"red\"\n");
+    CHECK_THROWS(KeyNotFound, bindAs<BoundChild>(child));
+    CHECK_THROWS(MismatchType, bindAs<BoundChild>(Parser().parseText("color = 1\nsize = 2\n")));
+    CHECK_THROWS(MismatchType, bindAs<BoundConf>(Parser().parseText("v_iarr = [1.5]\n")));
+}
+
+TEST_GROUP(EXAMPLE_DIFF)
+{
+};
+
+TEST(EXAMPLE_DIFF, diff)
+{
+    const auto a = parse("example.sml");
+    const auto b = parse("example2.sml");
+
+    CHECK(diff(a, parse("example.sml")).empty());
+
+    const auto sorted = [](std::vector<std::string> v) {
+        std::sort(std::begin(v), std::end(v));
+        return v;
+    };
+    const auto check = [&](const Diff& d) {
+        CHECK(sorted(d.added) == std::vector<std::string>({ "tarr[2]", "v_new" }));
+        CHECK(d.removed == std::vector<std::string>({ "v_str" }));
+        CHECK(sorted(d.changed) == std::vector<std::string>({ "t_singer.child.size", "v_iarr" }));
+    };
+
+    check(diff(a, b));
+
+    DiffOptions options;
+    options.parallelMinKeys = 4;
+    options.threads = 3;
+    check(diff(a, b, options));
+
+    const auto back = diff(b, a);
+    CHECK(back.added == std::vector<std::string>({ "v_str" }));
+    CHECK(sorted(back.removed) == std::vector<std::string>({ "tarr[2]", "v_new" }));
+
+    const auto zero = Parser().parseText("r = 0.0\nrarr = [0.0, 1.5]\n");
+    const auto negativeZero = Parser().parseText("r = -0.0\nrarr = [-0.0, 1.5]\n");
+    CHECK(equal(*zero, *negativeZero));
+    CHECK(diff(zero, negativeZero).empty());
+    CHECK(diff(zero, Parser().parseText("r = 0.5\nrarr = [0.0, 1.5]\n")).changed == std::vector<std::string>({ "r" }));
+}
+
+TEST_GROUP(EXAMPLE_INCREMENTAL)
+{
+};
+
+TEST(EXAMPLE_INCREMENTAL, IncrementalParser)
+{
+    IncrementalParser parser;
+    const auto a = parser.parse("example.sml");
+    CHECK(equal(*a, *parse("example.sml")));
+    CHECK(parser.reused() == 0);
+
+    const auto b = parser.parse("example2.sml");
+    CHECK(equal(*b, *parse("example2.sml")));
+    CHECK(parser.reused() == 1);
+    CHECK(parser.parsed() == 3);
+    CHECK(&valueAs<array_t>("usa", a) == &valueAs<array_t>("usa", b));
+    CHECK(&valueAs<table_t>("t_singer", a) != &valueAs<table_t>("t_singer", b));
+
+    const auto c = parser.parse("example2.sml");
+    CHECK(parser.reused() == 4);
+    CHECK(&valueAs<table_t>("t_singer", b) == &valueAs<table_t>("t_singer", c));
+    CHECK(diff(b, c).empty());
+
+    CHECK_THROWS(ParseException, parser.parseText("a = 1\n[a]\n"));
+    CHECK_THROWS(ParseException, parser.parseText("[a.b]\n"));
+    CHECK(parser.reused() == 4);
+
+    // CRLF line endings, as the text of files read in binary mode
+    const auto crlf = IncrementalParser().parseText("a = 1\r\n[b]\r\nc = 2\r\n");
+    CHECK(equal(*crlf, *Parser().parseText("a = 1\n[b]\nc = 2\n")));
+    CHECK(equal(*parser.parseText("a = 1\r\n[b]\r\nc = 2\r\n"), *parser.parseText("a = 1\n[b]\nc = 2\n")));
+    CHECK(parser.reused() == 2);
+}
+
+TEST_GROUP(EXAMPLE_OVERLAY)
+{
+};
+
+TEST(EXAMPLE_OVERLAY, Overlay)
+{
+    const auto base = parse("example.sml");
+    const auto region = parse("example2.sml");
+
+    Transaction txn(base);
+    txn.set("t_singer.child.color", std::string("red"));
+    txn.set("v_int", 7);
+    Overlay tenant({ base, region, txn.commit() });
+
+    CHECK(tenant.valueAs<integer_t>("v_int") == 7);
+    CHECK(tenant.valueAs<string_t>("v_str") == "Example String.");
+    CHECK(tenant.valueAs<string_t>("v_new") == "New String.");
+    CHECK(tenant.valueAs<std::vector<int>>("v_iarr") == std::vector<int>({ 4, 2, 5 }));
+    CHECK(tenant.valueAs<string_t>("t_singer.child.color") == "red");
+    CHECK(tenant.valueAs<string_t>("t_singer.child.food") == "lol");
+    CHECK_FALSE(tenant.contains("t_singer.child.none"));
+    CHECK_FALSE(tenant.contains("v_int.none"));
+    CHECK_THROWS(KeyNotFound, tenant.valueAs<integer_t>("none"));
+    CHECK_THROWS(MismatchType, tenant.valueAs<string_t>("v_int"));
+    CHECK(&tenant.valueAs<array_t>("usa") == &valueAs<array_t>("usa", base));
+
+    const auto child = tenant.at("t_singer.child");
+    CHECK(child.size() == 3);
+    CHECK(child.valueAs<integer_t>("size") == 75);
+    CHECK(child.keys() == std::vector<std::string>({ "color", "size", "food" }));
+
+    CHECK(tenant.flatten("t_singer.child.size"));
+    CHECK(tenant.valueAs<integer_t>("t_singer.child.size") == 75);
+
+    const auto gen = tenant.generation();
+    tenant.replace(1, parse("example.sml"));
+    CHECK(tenant.generation() == gen + 1);
+    CHECK(tenant.valueAs<integer_t>("t_singer.child.size") == 75);
+    CHECK_FALSE(tenant.contains("v_new"));
+
+    tenant.replace(2, region);
+    CHECK(tenant.valueAs<integer_t>("t_singer.child.size") == 76);
+    CHECK(tenant.layer(0) == base);
+}
+
+TEST_GROUP(EXAMPLE_RELOAD)
+{
+    void rewrite(const char* text)
+    {
+        std::ofstream out("reload.sml", std::ios::trunc);
+        out << text;
+    }
+
+    void teardown()
+    {
+        std::remove("reload.sml");
+    }
+};
+
+TEST(EXAMPLE_RELOAD, reload)
+{
+    rewrite("a = 1\n");
+    ConfigHandle config("reload.sml");
+    ConfigHandle::Reader reader(config);
+    CHECK(valueAs<integer_t>("a", *reader) == 1);
+    CHECK(config.generation() == 1);
+
+    CHECK_FALSE(config.reload());
+    CHECK(config.generation() == 1);
+
+    rewrite("a = 2\n");
+    Diff changes;
+    CHECK(config.reload([&](const ConfigHandle::Snapshot& before, const ConfigHandle::Snapshot& after) { changes = diff(before, after); }));
+    CHECK(config.generation() == 2);
+    CHECK(valueAs<integer_t>("a", *reader) == 2);
+    CHECK(changes.changed == std::vector<std::string>({ "a" }));
+
+    rewrite("a = \n");
+    CHECK_THROWS(ParseException, config.reload());
+    CHECK(valueAs<integer_t>("a", *reader) == 2);
+}
+
+TEST(EXAMPLE_RELOAD, watch)
+{
+    rewrite("a = 1\n");
+    ConfigHandle config("reload.sml");
+    config.watch(std::chrono::milliseconds(10));
+
+    rewrite("a = 3\n");
+    for (int i = 0; i < 300 && config.generation() == 1; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    config.unwatch();
+
+    CHECK(config.generation() == 2);
+    CHECK(valueAs<integer_t>("a", config.snapshot()) == 3);
+}
+
+TEST(EXAMPLE_RELOAD, Transaction)
+{
+    const auto base = parse("example.sml");
+    Transaction txn(base);
+    txn.set("t_singer.child.size", 80);
+    txn.set("new.key", std::string("value"));
+    txn.set("tarr[1].kcal", 50);
+    CHECK(txn.erase("v_str"));
+    CHECK_FALSE(txn.erase("v_none"));
+    CHECK_THROWS(MismatchType, txn.set("v_int.a", 1));
+    CHECK_THROWS(KeyNotFound, txn.set("none[0].a", 1));
+    CHECK_THROWS(ParseException, txn.set("tarr[1x].kcal", 1));
+    CHECK_THROWS(ParseException, txn.set("tarr[-1].kcal", 1));
+    CHECK_THROWS(ParseException, txn.set("tarr[].kcal", 1));
+    CHECK_THROWS(ParseException, txn.set("tarr[99999999999999999999999].kcal", 1));
+    const auto next = txn.commit();
+    CHECK_THROWS(std::logic_error, txn.commit());
+    CHECK_THROWS(std::logic_error, txn.erase("t_singer.size"));
+    CHECK_THROWS(std::logic_error, txn.set("a", 1));
+    CHECK_THROWS(std::invalid_argument, Transaction(nullptr));
+
+    const auto child = [](const std::shared_ptr<const table_t>& doc) -> const table_t& {
+        return valueAs<table_t>("child", valueAs<table_t>("t_singer", doc));
+    };
+    CHECK(valueAs<integer_t>("size", child(base)) == 75);
+    CHECK(valueAs<integer_t>("size", child(next)) == 80);
+    CHECK(valueAs<string_t>("key", valueAs<table_t>("new", next)) == "value");
+    CHECK(&valueAs<array_t>("usa", base) == &valueAs<array_t>("usa", next));
+    CHECK(&valueAs<array_t>("cute", valueAs<table_t>("t_singer", base)) == &valueAs<array_t>("cute", valueAs<table_t>("t_singer", next)));
+
+    const auto d = diff(base, next);
+    CHECK(d.added == std::vector<std::string>({ "new" }));
+    CHECK(d.removed == std::vector<std::string>({ "v_str" }));
+    auto changed = d.changed;
+    std::sort(std::begin(changed), std::end(changed));
+    CHECK(changed == std::vector<std::string>({ "t_singer.child.size", "tarr[1].kcal" }));
+
+    rewrite("a = 1\n");
+    ConfigHandle config("reload.sml");
+    Transaction stale(config.snapshot());
+    config.update([](Transaction& t) { t.set("a", 2); });
+    CHECK(config.generation() == 2);
+    CHECK(valueAs<integer_t>("a", config.snapshot()) == 2);
+
+    stale.set("a", 3);
+    CHECK_FALSE(config.commit(stale));
+    CHECK(valueAs<integer_t>("a", config.snapshot()) == 2);
+
+    // The file still has a = 1, reloading replaces the committed snapshot
+    const auto committed = config.snapshot();
+    ConfigHandle::Snapshot replaced;
+    CHECK(config.reload([&](const ConfigHandle::Snapshot& before, const ConfigHandle::Snapshot&) { replaced = before; }));
+    CHECK(replaced == committed);
+    CHECK(valueAs<integer_t>("a", config.snapshot()) == 1);
+}
+
+TEST_GROUP(EXAMPLE_RECLAIM)
+{
+};
+
+TEST(EXAMPLE_RECLAIM, DeepNesting)
+{
+    // Recursive destruction of this would overflow the stack
+    auto root = std::make_shared<array_t>();
+    for (int i = 0; i < 200000; ++i)
+    {
+        const auto outer = std::make_shared<array_t>();
+        outer->insertBack(root);
+        root = outer;
+    }
+    root.reset();
+    CHECK_FALSE(root);
+}
+
+TEST(EXAMPLE_RECLAIM, Reclaimer)
+{
+    Reclaimer reclaimer;
+    auto doc = reclaimer.adopt(parse("example.sml"));
+    CHECK(valueAs<integer_t>("v_int", doc) == 5);
+
+    const auto copy = doc;
+    doc.reset();
+    reclaimer.flush();
+    CHECK(reclaimer.stats().documents == 0);
+    CHECK(valueAs<integer_t>("v_int", copy) == 5);
+}
+
+TEST(EXAMPLE_RECLAIM, Release)
+{
+    // Record the thread which destroys each document
+    std::vector<std::thread::id> destroyedOn;
+    const auto hooked = [&destroyedOn] {
+        std::shared_ptr<const table_t> doc = parse("example.sml");
+        return std::shared_ptr<const table_t>(doc.get(), [&destroyedOn, doc](const table_t*) mutable {
+            destroyedOn.emplace_back(std::this_thread::get_id());
+            doc.reset();
+        });
+    };
+
+    Reclaimer reclaimer;
+    {
+        auto doc = reclaimer.adopt(hooked());
+    }
+    reclaimer.retire(hooked());
+    reclaimer.flush();
+
+    CHECK(destroyedOn.size() == 2);
+    for (const auto& id : destroyedOn)
+    {
+        CHECK(id != std::this_thread::get_id());
+        CHECK(id != std::thread::id());
+    }
+    CHECK(reclaimer.stats().documents == 2);
 }
\ No newline at end of file
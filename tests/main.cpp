@@ -1,7 +1,7 @@
-#include <CppUTest/CommandLineTestRunner.h>
-
-int main(int ac, char** av)
-{
-    const auto code = CommandLineTestRunner::RunAllTests(ac, av);
-    return code;
+#include <CppUTest/CommandLineTestRunner.h>
+
+int main(int ac, char** av)
+{
+    const auto code = CommandLineTestRunner::RunAllTests(ac, av);
+    return code;
 }
\ No newline at end of file
@@ -0,0 +1,111 @@
+// Compile a .sml file into C++ sources holding its frozen document.
+//
+//   smlembed <input.sml> <name> <output directory> [--perfect-hash]
+//
+// Writes <name>.h declaring 'const sml::FrozenDocument& <name>()' and <name>.cpp defining it.
+// The block is laid out by this tool, so it needs to be built with the same byte order
+// and the same integer_t and real_t as the program embedding it. The sizes are checked
+// when the source is compiled, the byte order when the document is first used.
+
+#include <sml.h>
+#include <cctype>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace
+{
+    void writeHeader(const std::string& path, const std::string& name)
+    {
+        std::string guard = "SML_EMBED_";
+        for (const auto c : name)
+        {
+            guard += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        }
+        guard += "_H";
+
+        std::ofstream out(path, std::ios::trunc);
+        out << "// Generated by smlembed. Do not edit.\n"
+            << "#ifndef " << guard << "\n"
+            << "#define " << guard << "\n"
+            << "\n"
+            << "#include <smlfrozen.h>\n"
+            << "\n"
+            << "const sml::FrozenDocument& " << name << "();\n"
+            << "\n"
+            << "#endif\n";
+        if (!out)
+        {
+            throw std::runtime_error("Failed to write file (" + path + ")");
+        }
+    }
+
+    void writeSource(const std::string& path, const std::string& name, const std::string& input, const sml::FrozenDocument& doc)
+    {
+        std::ofstream out(path, std::ios::trunc);
+        out << "// Generated by smlembed from " << input << ". Do not edit.\n"
+            << "#include \"" << name << ".h\"\n"
+            << "\n"
+            << "static_assert(sml::frozen::Version == " << sml::frozen::Version
+            << " && sizeof(sml::integer_t) == " << sizeof(sml::integer_t)
+            << " && sizeof(sml::real_t) == " << sizeof(sml::real_t) << ",\n"
+            << "              \"" << name << " was embedded by a build of another layout, rebuild smlembed with the same settings\");\n"
+            << "\n"
+            << "namespace\n"
+            << "{\n"
+            << "    alignas(" << sml::frozen::Align << ") const unsigned char data[] = {";
+
+        char hex[8];
+        for (size_t i = 0; i < doc.size(); ++i)
+        {
+            out << (i % 16 == 0 ? "\n        " : " ");
+            std::snprintf(hex, sizeof(hex), "0x%02x,", doc.data()[i]);
+            out << hex;
+        }
+
+        out << "\n"
+            << "    };\n"
+            << "}\n"
+            << "\n"
+            << "const sml::FrozenDocument& " << name << "()\n"
+            << "{\n"
+            << "    static const sml::FrozenDocument doc = sml::staticFrozen(data, sizeof(data));\n"
+            << "    return doc;\n"
+            << "}\n";
+        if (!out)
+        {
+            throw std::runtime_error("Failed to write file (" + path + ")");
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cerr << "usage: smlembed <input.sml> <name> <output directory> [--perfect-hash]" << std::endl;
+        return 2;
+    }
+
+    const std::string input = argv[1];
+    const std::string name = argv[2];
+    const std::string dir = argv[3];
+
+    sml::FreezeOptions options;
+    options.perfectHash = argc > 4 && std::string(argv[4]) == "--perfect-hash";
+
+    try
+    {
+        const auto doc = sml::freeze(sml::parse(input), options);
+        writeHeader(dir + "/" + name + ".h", name);
+        writeSource(dir + "/" + name + ".cpp", name, input, doc);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << input << ": " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
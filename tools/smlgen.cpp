@@ -0,0 +1,711 @@
+// Generate C++ structs and a parser specialized for them from sample .sml files.
+//
+//   smlgen <Name> <output.h> <sample.sml>...
+//
+// The schema is inferred from the samples. A key found in every instance of its table
+// becomes a plain field, otherwise a std::optional field. Values of conflicting types and
+// arrays of mixed types become std::shared_ptr<const sml::Value> fields.
+// The header declares the root struct <Name> and <Name>Schema, loaded by
+//   <Name> config = sml::gen::load<<Name>Schema>("config.sml");
+
+#include <sml.h>
+#include <smlgen.h>
+#include <algorithm>
+#include <cctype>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    enum class Kind
+    {
+        Unknown,
+        Integer,
+        Real,
+        String,
+        Vector,
+        Table,
+        TableArray,
+        Generic,
+    };
+
+    struct Type
+    {
+        Kind kind = Kind::Unknown;
+        std::shared_ptr<Type> element; // Of a vector
+        size_t record = 0;             // Of a table or a table array
+    };
+
+    struct Field
+    {
+        std::string key;
+        std::string member;
+        Type type;
+        size_t seen = 0;
+    };
+
+    struct Record
+    {
+        std::string name;
+        std::vector<Field> fields;
+        size_t instances = 0;
+    };
+
+    class Schema
+    {
+    private:
+        std::vector<Record> records_;
+
+    public:
+        explicit Schema(const std::string& name)
+        {
+            records_.push_back(Record{ name, {}, 0 });
+        }
+
+        const std::vector<Record>& records() const
+        {
+            return records_;
+        }
+
+        void add(const sml::table_t& root)
+        {
+            addTable(0, root);
+        }
+
+        /// Make types never seen or vectors of such types generic.
+        void normalize()
+        {
+            for (auto& r : records_)
+            {
+                for (auto& f : r.fields)
+                {
+                    normalize(f.type);
+                }
+            }
+        }
+
+    private:
+        void addTable(size_t r, const sml::table_t& table)
+        {
+            ++records_[r].instances;
+            for (const auto e : table)
+            {
+                auto& fields = records_[r].fields;
+                auto found = std::find_if(std::begin(fields), std::end(fields), [&](const Field& f) { return f.key == e.first; });
+                if (found == std::end(fields))
+                {
+                    fields.push_back(Field{ e.first, memberName(fields, e.first), Type(), 0 });
+                    found = std::end(fields) - 1;
+                }
+                ++found->seen;
+
+                // Records may grow while merging, take the name by value
+                const auto name = records_[r].name + "_" + found->member;
+                auto type = found->type;
+                merge(type, e.second, name);
+                std::find_if(std::begin(records_[r].fields), std::end(records_[r].fields), [&](const Field& f) { return f.key == e.first; })->type = type;
+            }
+        }
+
+        size_t makeRecord(const std::string& name)
+        {
+            records_.push_back(Record{ name, {}, 0 });
+            return records_.size() - 1;
+        }
+
+        static void mergeScalar(Type& type, Kind kind)
+        {
+            if (type.kind == Kind::Unknown)
+            {
+                type.kind = kind;
+            }
+            else if (type.kind != kind)
+            {
+                type.kind = Kind::Generic;
+            }
+        }
+
+        void merge(Type& type, const sml::Value& val, const std::string& name)
+        {
+            if (type.kind == Kind::Generic)
+            {
+                return;
+            }
+
+            switch (val.type())
+            {
+            case sml::ValueType::Integer:
+                mergeScalar(type, Kind::Integer);
+                break;
+            case sml::ValueType::Real:
+                mergeScalar(type, Kind::Real);
+                break;
+            case sml::ValueType::String:
+                mergeScalar(type, Kind::String);
+                break;
+            case sml::ValueType::Table:
+                if (type.kind == Kind::Unknown)
+                {
+                    type.kind = Kind::Table;
+                    type.record = makeRecord(name);
+                }
+                if (type.kind != Kind::Table)
+                {
+                    type.kind = Kind::Generic;
+                    break;
+                }
+                addTable(type.record, sml::valueAs<sml::table_t>(val));
+                break;
+            case sml::ValueType::Array:
+                mergeArray(type, sml::valueAs<sml::array_t>(val), name);
+                break;
+            default:
+                type.kind = Kind::Generic;
+                break;
+            }
+        }
+
+        void mergeArray(Type& type, const sml::array_t& arr, const std::string& name)
+        {
+            if (arr.elementType() == sml::ValueType::Table)
+            {
+                if (type.kind == Kind::Unknown)
+                {
+                    type.kind = Kind::TableArray;
+                    type.record = makeRecord(name);
+                }
+                if (type.kind != Kind::TableArray)
+                {
+                    type.kind = Kind::Generic;
+                    return;
+                }
+                for (size_t i = 0; i < arr.length(); ++i)
+                {
+                    addTable(type.record, arr.valueAs<sml::table_t>(i));
+                }
+                return;
+            }
+
+            if (type.kind == Kind::Unknown)
+            {
+                type.kind = Kind::Vector;
+                type.element = std::make_shared<Type>();
+            }
+            if (type.kind != Kind::Vector)
+            {
+                type.kind = Kind::Generic;
+                return;
+            }
+
+            auto& element = *type.element;
+            switch (arr.elementType())
+            {
+            case sml::ValueType::Integer:
+                mergeScalar(element, Kind::Integer);
+                break;
+            case sml::ValueType::Real:
+                mergeScalar(element, Kind::Real);
+                break;
+            case sml::ValueType::String:
+                mergeScalar(element, Kind::String);
+                break;
+            case sml::ValueType::Array:
+                for (size_t i = 0; i < arr.length() && element.kind != Kind::Generic; ++i)
+                {
+                    mergeArray(element, arr.valueAs<sml::array_t>(i), name);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        static bool normalize(Type& type)
+        {
+            if (type.kind == Kind::Vector && !normalize(*type.element))
+            {
+                type.kind = Kind::Generic;
+            }
+            if (type.kind == Kind::Unknown)
+            {
+                type.kind = Kind::Generic;
+            }
+            return type.kind != Kind::Generic;
+        }
+
+        static std::string memberName(const std::vector<Field>& fields, const std::string& key)
+        {
+            static const std::set<std::string> keywords = {
+                "alignas", "alignof", "and", "asm", "auto", "bool", "break", "case", "catch", "char", "class",
+                "const", "constexpr", "continue", "default", "delete", "do", "double", "else", "enum", "explicit",
+                "export", "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int", "long",
+                "mutable", "namespace", "new", "noexcept", "not", "nullptr", "operator", "or", "private",
+                "protected", "public", "register", "return", "short", "signed", "sizeof", "static", "struct",
+                "switch", "template", "this", "throw", "true", "try", "typedef", "typename", "union", "unsigned",
+                "using", "virtual", "void", "volatile", "while", "xor", "sml_present",
+            };
+
+            std::string name;
+            for (const auto c : key)
+            {
+                name += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+            }
+            if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0])))
+            {
+                name = "_" + name;
+            }
+            if (keywords.count(name))
+            {
+                name += "_";
+            }
+
+            auto unique = name;
+            for (size_t i = 2; std::any_of(std::begin(fields), std::end(fields), [&](const Field& f) { return f.member == unique; }); ++i)
+            {
+                unique = name + "_" + std::to_string(i);
+            }
+            return unique;
+        }
+    };
+
+    class Generator
+    {
+    private:
+        const std::vector<Record>& records_;
+        std::string schema_;
+        std::ostringstream out_;
+
+    public:
+        Generator(const Schema& schema)
+            : records_(schema.records())
+            , schema_(schema.records()[0].name + "Schema")
+        {
+        }
+
+        std::string generate(const std::string& sources)
+        {
+            const auto& root = records_[0].name;
+            std::string guard = "SML_GEN_";
+            for (const auto c : root)
+            {
+                guard += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            }
+            guard += "_H";
+
+            out_ << "// Generated by smlgen from " << sources << ". Do not edit.\n"
+                 << "#ifndef " << guard << "\n"
+                 << "#define " << guard << "\n"
+                 << "\n"
+                 << "#include <smlgen.h>\n"
+                 << "#include <bitset>\n"
+                 << "#include <memory>\n"
+                 << "#include <optional>\n"
+                 << "#include <string>\n"
+                 << "#include <string_view>\n"
+                 << "#include <vector>\n";
+
+            // Children are made after their parents
+            for (size_t r = records_.size(); r-- > 0;)
+            {
+                structOf(records_[r]);
+            }
+
+            out_ << "\n"
+                 << "struct " << schema_ << "\n"
+                 << "{\n"
+                 << "    using Root = " << root << ";\n"
+                 << "\n"
+                 << "    enum Kind\n"
+                 << "    {\n";
+            for (const auto& r : records_)
+            {
+                out_ << "        Kind_" << r.name << ",\n";
+            }
+            out_ << "    };\n";
+
+            for (const auto& r : records_)
+            {
+                keysOf(r);
+            }
+
+            setOf();
+            openOf();
+            for (const auto& r : records_)
+            {
+                setOf(r);
+                completeOf(r);
+                bindOf(r);
+            }
+
+            out_ << "};\n"
+                 << "\n"
+                 << "#endif\n";
+            return out_.str();
+        }
+
+    private:
+        std::string typeOf(const Type& type) const
+        {
+            switch (type.kind)
+            {
+            case Kind::Integer:
+                return "sml::integer_t";
+            case Kind::Real:
+                return "sml::real_t";
+            case Kind::String:
+                return "std::string";
+            case Kind::Vector:
+                return "std::vector<" + typeOf(*type.element) + ">";
+            case Kind::Table:
+                return records_[type.record].name;
+            case Kind::TableArray:
+                return "std::vector<" + records_[type.record].name + ">";
+            default:
+                return "std::shared_ptr<const sml::Value>";
+            }
+        }
+
+        /// Whether the field is missing from some instances and wrapped by std::optional.
+        bool optional(const Record& r, const Field& f) const
+        {
+            return f.seen < r.instances && f.type.kind != Kind::TableArray && f.type.kind != Kind::Generic;
+        }
+
+        /// Whether the field needs to be found. Table arrays and generic values may be missing.
+        bool required(const Record& r, const Field& f) const
+        {
+            return !optional(r, f) && f.type.kind != Kind::TableArray && f.type.kind != Kind::Generic;
+        }
+
+        /// Expression of the field to fill, making the optional value.
+        std::string target(const Record& r, const Field& f, const std::string& s) const
+        {
+            return optional(r, f) ? s + f.member + ".emplace()" : s + f.member;
+        }
+
+        void structOf(const Record& r)
+        {
+            out_ << "\n"
+                 << "struct " << r.name << "\n"
+                 << "{\n";
+            for (const auto& f : r.fields)
+            {
+                const auto type = typeOf(f.type);
+                out_ << "    " << (optional(r, f) ? "std::optional<" + type + ">" : type) << " " << f.member;
+                if (!optional(r, f) && (f.type.kind == Kind::Integer || f.type.kind == Kind::Real))
+                {
+                    out_ << " = 0";
+                }
+                out_ << ";\n";
+            }
+            out_ << "\n"
+                 << "    // Fields found, in the order above\n"
+                 << "    std::bitset<" << r.fields.size() << "> sml_present;\n"
+                 << "};\n";
+        }
+
+        void keysOf(const Record& r)
+        {
+            if (r.fields.empty())
+            {
+                return;
+            }
+            out_ << "\n"
+                 << "    static constexpr std::string_view Keys_" << r.name << "[] = {";
+            for (size_t i = 0; i < r.fields.size(); ++i)
+            {
+                out_ << (i == 0 ? " " : ", ") << "\"" << r.fields[i].key << "\"";
+            }
+            out_ << " };\n";
+        }
+
+        std::string requiredOf(const Record& r) const
+        {
+            std::string bits;
+            for (size_t i = r.fields.size(); i-- > 0;)
+            {
+                bits += required(r, r.fields[i]) ? '1' : '0';
+            }
+            return bits;
+        }
+
+        void setOf()
+        {
+            out_ << "\n"
+                 << "    static bool set(sml::gen::Cursor& c, std::string_view key, sml::gen::Reader& r)\n"
+                 << "    {\n"
+                 << "        switch (c.kind)\n"
+                 << "        {\n";
+            for (const auto& r : records_)
+            {
+                out_ << "        case Kind_" << r.name << ":\n"
+                     << "            return set(*static_cast<" << r.name << "*>(c.table), key, r, c.hint);\n";
+            }
+            out_ << "        }\n"
+                 << "        return false;\n"
+                 << "    }\n";
+        }
+
+        void setOf(const Record& r)
+        {
+            out_ << "\n"
+                 << "    static bool set(" << r.name << "& s, std::string_view key, sml::gen::Reader& r, size_t& hint)\n"
+                 << "    {\n";
+            const auto scalar = std::any_of(std::begin(r.fields), std::end(r.fields), [](const Field& f) { return f.type.kind != Kind::Table && f.type.kind != Kind::TableArray; });
+            if (!scalar)
+            {
+                out_ << "        (void)s;\n"
+                     << "        (void)key;\n"
+                     << "        (void)r;\n"
+                     << "        (void)hint;\n"
+                     << "        return false;\n"
+                     << "    }\n";
+                return;
+            }
+
+            out_ << "        const auto i = sml::gen::slotOf(Keys_" << r.name << ", key, s.sml_present, hint);\n"
+                 << "        switch (i)\n"
+                 << "        {\n";
+            for (size_t i = 0; i < r.fields.size(); ++i)
+            {
+                const auto& f = r.fields[i];
+                if (f.type.kind == Kind::Table || f.type.kind == Kind::TableArray)
+                {
+                    continue;
+                }
+                out_ << "        case " << i << ":\n"
+                     << "            if (!r.read(" << target(r, f, "s.") << "))\n"
+                     << "            {\n"
+                     << "                return false;\n"
+                     << "            }\n"
+                     << "            break;\n";
+            }
+            out_ << "        default:\n"
+                 << "            return false;\n"
+                 << "        }\n"
+                 << "        s.sml_present.set(i);\n"
+                 << "        hint = i + 1;\n"
+                 << "        return true;\n"
+                 << "    }\n";
+        }
+
+        struct Step
+        {
+            const Record* record;
+            size_t field;
+        };
+
+        void openOf()
+        {
+            out_ << "\n"
+                 << "    static bool open([[maybe_unused]] Root& root, [[maybe_unused]] std::string_view path,\n"
+                 << "                     [[maybe_unused]] bool array, [[maybe_unused]] sml::gen::Cursor& c)\n"
+                 << "    {\n";
+            std::vector<Step> steps;
+            openOf(records_[0], "", steps);
+            out_ << "        return false;\n"
+                 << "    }\n";
+        }
+
+        void openOf(const Record& r, const std::string& prefix, std::vector<Step>& steps)
+        {
+            for (size_t i = 0; i < r.fields.size(); ++i)
+            {
+                const auto& f = r.fields[i];
+                if (f.type.kind != Kind::Table && f.type.kind != Kind::TableArray)
+                {
+                    continue;
+                }
+
+                steps.push_back(Step{ &r, i });
+                const auto path = prefix + f.key;
+                openPath(path, steps);
+                openOf(records_[f.type.record], path + ".", steps);
+                steps.pop_back();
+            }
+        }
+
+        void openPath(const std::string& path, const std::vector<Step>& steps)
+        {
+            const auto& last = steps.back();
+            const auto& f = last.record->fields[last.field];
+            const auto array = f.type.kind == Kind::TableArray;
+
+            out_ << "        if (" << (array ? "array" : "!array") << " && path == \"" << path << "\")\n"
+                 << "        {\n"
+                 << "            auto* t0 = &root;\n";
+            for (size_t k = 0; k + 1 < steps.size(); ++k)
+            {
+                const auto& step = steps[k];
+                const auto& g = step.record->fields[step.field];
+                const auto t = "t" + std::to_string(k);
+                const auto next = "t" + std::to_string(k + 1);
+                if (g.type.kind == Kind::TableArray)
+                {
+                    out_ << "            if (" << t << "->" << g.member << ".empty())\n"
+                         << "            {\n"
+                         << "                return false;\n"
+                         << "            }\n"
+                         << "            auto* " << next << " = &" << t << "->" << g.member << ".back();\n";
+                }
+                else
+                {
+                    out_ << "            if (!" << t << "->sml_present.test(" << step.field << "))\n"
+                         << "            {\n"
+                         << "                return false;\n"
+                         << "            }\n"
+                         << "            auto* " << next << " = &" << (optional(*step.record, g) ? "*" : "") << t << "->" << g.member << ";\n";
+                }
+            }
+
+            const auto t = "t" + std::to_string(steps.size() - 1);
+            const auto& child = records_[f.type.record];
+            if (array)
+            {
+                out_ << "            " << t << "->sml_present.set(" << last.field << ");\n"
+                     << "            c = sml::gen::Cursor{ Kind_" << child.name << ", &" << t << "->" << f.member << ".emplace_back(), 0 };\n";
+            }
+            else
+            {
+                out_ << "            if (" << t << "->sml_present.test(" << last.field << "))\n"
+                     << "            {\n"
+                     << "                return false;\n"
+                     << "            }\n"
+                     << "            " << t << "->sml_present.set(" << last.field << ");\n"
+                     << "            c = sml::gen::Cursor{ Kind_" << child.name << ", &" << target(*last.record, f, t + "->") << ", 0 };\n";
+            }
+            out_ << "            return true;\n"
+                 << "        }\n";
+        }
+
+        void completeOf(const Record& r)
+        {
+            out_ << "\n"
+                 << "    static bool complete(const " << r.name << "& s)\n"
+                 << "    {\n"
+                 << "        static const std::bitset<" << r.fields.size() << "> required(\"" << requiredOf(r) << "\");\n"
+                 << "        if ((s.sml_present & required) != required)\n"
+                 << "        {\n"
+                 << "            return false;\n"
+                 << "        }\n";
+            for (const auto& f : r.fields)
+            {
+                if (f.type.kind == Kind::Table)
+                {
+                    if (optional(r, f))
+                    {
+                        out_ << "        if (s." << f.member << " && !complete(*s." << f.member << "))\n";
+                    }
+                    else
+                    {
+                        out_ << "        if (!complete(s." << f.member << "))\n";
+                    }
+                    out_ << "        {\n"
+                         << "            return false;\n"
+                         << "        }\n";
+                }
+                else if (f.type.kind == Kind::TableArray)
+                {
+                    out_ << "        for (const auto& e : s." << f.member << ")\n"
+                         << "        {\n"
+                         << "            if (!complete(e))\n"
+                         << "            {\n"
+                         << "                return false;\n"
+                         << "            }\n"
+                         << "        }\n";
+                }
+            }
+            out_ << "        return true;\n"
+                 << "    }\n";
+        }
+
+        void bindOf(const Record& r)
+        {
+            out_ << "\n"
+                 << "    static void bind(const sml::table_t& t, " << r.name << "& s)\n"
+                 << "    {\n";
+            if (r.fields.empty())
+            {
+                out_ << "        (void)t;\n"
+                     << "        (void)s;\n"
+                     << "    }\n";
+                return;
+            }
+
+            for (size_t i = 0; i < r.fields.size(); ++i)
+            {
+                const auto& f = r.fields[i];
+                out_ << "        if (const auto v = t." << (f.type.kind == Kind::Generic ? "node" : "find") << "(\"" << f.key << "\"))\n"
+                     << "        {\n";
+                switch (f.type.kind)
+                {
+                case Kind::Table:
+                    out_ << "            bind(sml::valueAs<sml::table_t>(*v), " << target(r, f, "s.") << ");\n";
+                    break;
+                case Kind::TableArray:
+                    out_ << "            const auto& arr = sml::valueAs<sml::array_t>(*v);\n"
+                         << "            for (size_t i = 0; i < arr.length(); ++i)\n"
+                         << "            {\n"
+                         << "                bind(arr.valueAs<sml::table_t>(i), s." << f.member << ".emplace_back());\n"
+                         << "            }\n";
+                    break;
+                case Kind::Generic:
+                    out_ << "            s." << f.member << " = v;\n";
+                    break;
+                default:
+                    out_ << "            sml::gen::bindValue(*v, " << target(r, f, "s.") << ");\n";
+                    break;
+                }
+                out_ << "            s.sml_present.set(" << i << ");\n"
+                     << "        }\n";
+            }
+            out_ << "        static const std::bitset<" << r.fields.size() << "> required(\"" << requiredOf(r) << "\");\n"
+                 << "        sml::gen::require(s.sml_present, required, Keys_" << r.name << ");\n"
+                 << "    }\n";
+        }
+    };
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cerr << "usage: smlgen <Name> <output.h> <sample.sml>..." << std::endl;
+        return 2;
+    }
+
+    const std::string name = argv[1];
+    const std::string output = argv[2];
+
+    try
+    {
+        Schema schema(name);
+        std::string sources;
+        for (int i = 3; i < argc; ++i)
+        {
+            schema.add(*sml::parse(argv[i]));
+            sources += (i == 3 ? "" : ", ") + std::string(argv[i]);
+        }
+        schema.normalize();
+
+        const auto code = Generator(schema).generate(sources);
+        std::ofstream out(output, std::ios::trunc);
+        if (!(out << code))
+        {
+            throw std::runtime_error("Failed to write file (" + output + ")");
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}